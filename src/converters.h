@@ -1,6 +1,14 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 #include "bspan.h"
 
 namespace waavs {
@@ -54,6 +62,23 @@ namespace waavs {
 		//    (((uint8_t *)fStart)[4] << 32) | (((uint8_t *)fStart)[5] << 40) | (((uint8_t *)fStart)[6] << 48) | (((uint8_t *)fStart)[7] << 56);
 	}
 
+	// Read a double precision value
+	// assuming stream is in little endian format
+	// This one goes through memcpy(), so it is safe to use on
+	// unaligned data, and swaps if the machine is big-endian
+	static INLINE double as_f64_le(const void* data) noexcept
+	{
+		uint64_t r;
+		memcpy(&r, data, sizeof(r));
+		if (isBE())
+			r = bswap64(r);
+
+		double v;
+		memcpy(&v, &r, sizeof(v));
+
+		return v;
+	}
+
 	//=============================================
 	// BIG ENDIAN
 	//=============================================
@@ -195,4 +220,105 @@ namespace waavs {
 	{
 		return read_u64_le(bs, (uint64_t&)value);
 	}
-}
\ No newline at end of file
+}
+
+namespace waavs {
+	//
+	// bswap32_array()
+	// 
+	// Byte swap an array of 32-bit values, such as the big endian
+	// offset/length pairs of a .shx file.  The source does not need
+	// to be aligned.  The widest instruction set the compiler has
+	// been told it can use is selected at compile time, and a scalar
+	// loop handles whatever is left over.
+	//
+	static void bswap32_array(const void* src, uint32_t* dst, size_t count) noexcept
+	{
+		const uint8_t* s = (const uint8_t*)src;
+		size_t i = 0;
+
+#if defined(__AVX2__)
+		const __m256i shuf = _mm256_setr_epi8(
+			3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+			3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i v = _mm256_loadu_si256((const __m256i*)(s + i * 4));
+			_mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(v, shuf));
+		}
+#elif defined(__SSSE3__)
+		const __m128i shuf = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(s + i * 4));
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(v, shuf));
+		}
+#elif defined(__SSE2__) || defined(_M_X64)
+		// No byte shuffle, so swap the bytes within the 16-bit halves
+		// then swap the halves
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(s + i * 4));
+			v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+			v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+			v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+			_mm_storeu_si128((__m128i*)(dst + i), v);
+		}
+#endif
+
+		for (; i < count; ++i)
+		{
+			uint32_t v;
+			memcpy(&v, s + i * 4, 4);
+			dst[i] = bswap32(v);
+		}
+	}
+}
+
+namespace waavs {
+	//
+	// Bulk copies of little-endian arrays
+	// 
+	// These do no bounds checking, so the caller checks once, for
+	// the whole array, rather than once per value.  On a little-endian
+	// machine, the bytes are already in the right order, so it's a single
+	// memcpy(), which the C runtime does with the widest loads available.
+	// On a big-endian machine, each value is swapped, in a loop simple 
+	// enough for the compiler to vectorize.
+	//
+	static void copy_f64_le(const void* src, double* dst, size_t count) noexcept
+	{
+		if (isLE())
+		{
+			memcpy(dst, src, count * sizeof(double));
+			return;
+		}
+
+		const uint8_t* s = (const uint8_t*)src;
+		uint64_t* d = (uint64_t*)dst;
+		for (size_t i = 0; i < count; i++)
+		{
+			uint64_t v;
+			memcpy(&v, s + (i * 8), 8);
+			d[i] = bswap64(v);
+		}
+	}
+
+	static void copy_i32_le(const void* src, int32_t* dst, size_t count) noexcept
+	{
+		if (isLE())
+		{
+			memcpy(dst, src, count * sizeof(int32_t));
+			return;
+		}
+
+		const uint8_t* s = (const uint8_t*)src;
+		uint32_t* d = (uint32_t*)dst;
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t v;
+			memcpy(&v, s + (i * 4), 4);
+			d[i] = bswap32(v);
+		}
+	}
+}
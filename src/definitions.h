@@ -38,6 +38,31 @@
 #endif // unlikely
 #endif
 
+// Mark a function as compiled for AVX2, so it can use the AVX2 intrinsics
+// while the rest of the program is built for a baseline CPU.  Only call
+// such a function after checking the CPU supports it.
+// MSVC++ allows the intrinsics anywhere, so it needs nothing.
+#ifndef WAAVS_TARGET_AVX2
+#if defined(_MSC_VER) && !defined(__clang__)
+#define WAAVS_TARGET_AVX2
+#else
+#define WAAVS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Keep the compiler from fusing a multiply and an add into an FMA, in
+// code that has to give the same bits whichever way it's built.  Clang
+// takes this as the first thing in a function body, GCC needs
+// '#pragma GCC optimize ("fp-contract=off")' around the functions.
+// MSVC++ only contracts with /fp:fast or /fp:contract.
+#ifndef WAAVS_FP_CONTRACT_OFF
+#if defined(__clang__)
+#define WAAVS_FP_CONTRACT_OFF _Pragma("clang fp contract(off)")
+#else
+#define WAAVS_FP_CONTRACT_OFF
+#endif
+#endif
+
 // MSVC++ has #defines for min/max that break various things
 // so undef them, as we won't want to use those
 #if WAAVS_NOMINMAX
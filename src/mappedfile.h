@@ -10,12 +10,27 @@
 	local m = MappedFile::create_shared(filename)
 
 	local bs = binstream(m:getPointer(), #m)
+
+	On Windows, the mapping is done with CreateFileMappingA/MapViewOfFile.
+	Everywhere else, the POSIX open/mmap calls are used, and the caller
+	can give a hint as to how the mapping will be accessed, so the kernel
+	can do appropriate read-ahead.
+
+	Usage (POSIX):
+	auto m = MappedFile::create_shared(filename, MapAccess::Sequential, MAP_FLAG_POPULATE);
 */
+#ifdef _WIN32
 #include <SDKDDKVer.h>
 
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include <cstdio>
 #include <string>
@@ -23,6 +38,28 @@
 #include <memory>
 
 
+namespace waavs
+{
+    // MapAccess
+    // A hint as to how the mapped bytes are going to be touched.
+    // Sequential - a front to back scan of the .shp content
+    // Random - jumping around, typically driven by the .shx offsets
+    // WillNeed - the whole range is about to be used, so start reading it now
+    enum class MapAccess : uint32_t
+    {
+        Normal = 0,
+        Sequential = 1,
+        Random = 2,
+        WillNeed = 3
+    };
+
+    // Flags that can be or'd together to alter how the mapping is created
+    static constexpr uint32_t MAP_FLAG_NONE = 0x00;
+    static constexpr uint32_t MAP_FLAG_POPULATE = 0x01;     // pre-fault the pages while mapping
+    static constexpr uint32_t MAP_FLAG_HUGEPAGES = 0x02;    // ask for transparent huge pages, if supported
+}
+
+#ifdef _WIN32
 namespace waavs
 {
     struct MappedFile
@@ -105,7 +142,7 @@ namespace waavs
 
             if (filehandle == INVALID_HANDLE_VALUE) {
                 // BUGBUG - do anything more than returning invalid?
-                printf("Could not create/open file for mmap: %d  %s", ::GetLastError(), fname);
+                fprintf(stderr, "Could not create/open file for mmap: %d  %s\n", ::GetLastError(), fname);
                 return {};
             }
 
@@ -146,5 +183,176 @@ namespace waavs
 
             return std::make_shared<MappedFile>(filehandle, maphandle, data, size);
         }
+
+        // advise()
+        // Only WillNeed means anything on Windows, where it turns into
+        // a prefetch of the range.  The other hints are accepted, and ignored.
+        bool advise(MapAccess access, size_t offset = 0, size_t length = 0) const noexcept
+        {
+            if (fData == nullptr || offset >= fSize)
+                return false;
+
+            if (access != MapAccess::WillNeed)
+                return true;
+
+            if (length == 0 || length > fSize - offset)
+                length = fSize - offset;
+
+            WIN32_MEMORY_RANGE_ENTRY range{ (uint8_t*)fData + offset, length };
+            return ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0) != 0;
+        }
+
+        // Same factory signature as the POSIX version, so portable code
+        // can give access hints without caring which platform it's on
+        static std::shared_ptr<MappedFile> create_shared(const std::string& filename,
+            MapAccess access,
+            uint32_t mapFlags = MAP_FLAG_NONE) noexcept
+        {
+            auto m = create_shared(filename, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING);
+            if (m && ((access == MapAccess::WillNeed) || (mapFlags & MAP_FLAG_POPULATE)))
+                m->advise(MapAccess::WillNeed);
+
+            return m;
+        }
+    };
+}
+#else
+namespace waavs
+{
+    struct MappedFile
+    {
+        void* fData{};
+        size_t fSize{};
+        bool fIsValid{};
+
+        int fFileHandle{ -1 };
+
+    public:
+        MappedFile(int filehandle, void* data, size_t length) noexcept
+            :fData(data)
+            , fSize(length)
+            , fFileHandle(filehandle)
+        {
+            fIsValid = true;
+        }
+
+
+        MappedFile() noexcept
+            : fData(nullptr)
+            , fSize(0)
+            , fIsValid(false)
+            , fFileHandle(-1)
+        {}
+
+        virtual ~MappedFile() noexcept { close(); }
+
+        bool isValid() const noexcept { return fIsValid; }
+        void* data() const noexcept { return fData; }
+        size_t size() const noexcept { return fSize; }
+
+        bool close() noexcept
+        {
+            if (fData != nullptr) {
+                ::munmap(fData, fSize);
+                fData = nullptr;
+            }
+
+            if (fFileHandle != -1) {
+                ::close(fFileHandle);
+                fFileHandle = -1;
+            }
+
+            fIsValid = false;
+
+            return true;
+        }
+
+        // advise()
+        // Change the access hint for a range of the mapping after it
+        // has been created.  A typical use is to map a .shp with Random
+        // access, then issue WillNeed on just the range of records that
+        // are about to be processed.
+        // The offset is rounded down to a page boundary, as madvise requires.
+        bool advise(MapAccess access, size_t offset = 0, size_t length = 0) const noexcept
+        {
+            if (fData == nullptr || offset >= fSize)
+                return false;
+
+            if (length == 0 || length > fSize - offset)
+                length = fSize - offset;
+
+            static const size_t pageSize = (size_t)::sysconf(_SC_PAGESIZE);
+            size_t aligned = offset - (offset % pageSize);
+            length += offset - aligned;
+
+            return ::madvise((uint8_t*)fData + aligned, length, adviceFor(access)) == 0;
+        }
+
+        static int adviceFor(MapAccess access) noexcept
+        {
+            switch (access)
+            {
+            case MapAccess::Sequential: return MADV_SEQUENTIAL;
+            case MapAccess::Random: return MADV_RANDOM;
+            case MapAccess::WillNeed: return MADV_WILLNEED;
+            default: return MADV_NORMAL;
+            }
+        }
+
+        // factory method
+        // access - the hint for how the pages will be touched
+        // mapFlags - MAP_FLAG_POPULATE, MAP_FLAG_HUGEPAGES
+        //
+        // The mapping is always read-only and private, which is all the 
+        // shapefile readers need.
+        static std::shared_ptr<MappedFile> create_shared(const std::string& filename,
+            MapAccess access = MapAccess::Normal,
+            uint32_t mapFlags = MAP_FLAG_NONE) noexcept
+        {
+            const char* fname = filename.c_str();
+            int filehandle = ::open(fname, O_RDONLY | O_CLOEXEC);
+
+            if (filehandle == -1) {
+                fprintf(stderr, "Could not create/open file for mmap: %s\n", fname);
+                return {};
+            }
+
+            struct stat st {};
+            if ((::fstat(filehandle, &st) != 0) || (st.st_size <= 0))
+            {
+                // mmap() will not map a zero length file
+                ::close(filehandle);
+                return {};
+            }
+
+            size_t size = (size_t)st.st_size;
+
+            int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+            if (mapFlags & MAP_FLAG_POPULATE)
+                flags |= MAP_POPULATE;
+#endif
+
+            void* data = ::mmap(nullptr, size, PROT_READ, flags, filehandle, 0);
+
+            if (data == MAP_FAILED) {
+                ::close(filehandle);
+                return {};
+            }
+
+            // Hints are just that, so failures here are not fatal
+            if (access != MapAccess::Normal)
+                ::madvise(data, size, adviceFor(access));
+
+#ifdef MADV_HUGEPAGE
+            // Only takes effect for file backed memory when the kernel
+            // has been built with read-only THP for the page cache
+            if (mapFlags & MAP_FLAG_HUGEPAGES)
+                ::madvise(data, size, MADV_HUGEPAGE);
+#endif
+
+            return std::make_shared<MappedFile>(filehandle, data, size);
+        }
     };
-}
\ No newline at end of file
+}
+#endif
@@ -119,6 +119,7 @@ namespace waavs
     INLINE float gain(float a, float gain);
 
     INLINE float map(float x, float olow, float ohigh, float rlow, float rhigh);
+    INLINE double map(double x, double olow, double ohigh, double rlow, double rhigh);
     INLINE float floor(float a);
     INLINE float ceil(float a);
     INLINE bool isNaN(const float a);
@@ -189,6 +190,11 @@ namespace waavs
         return rlow + (x - olow) * ((rhigh - rlow) / (ohigh - olow));
     }
 
+    static INLINE double map(double x, double olow, double ohigh, double rlow, double rhigh)
+    {
+        return rlow + (x - olow) * ((rhigh - rlow) / (ohigh - olow));
+    }
+
     static INLINE float floor(float a) { return std::floor(a); }
     static INLINE float ceil(float a) { return std::ceil(a); }
     static INLINE bool isNaN(const float a) { return std::isnan(a); }
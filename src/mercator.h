@@ -1,5 +1,16 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define WAAVS_MERCATOR_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
 
 #include "maths.h"
 
@@ -34,6 +45,620 @@ namespace waavs {
 		//y = MAX_WEB_MERCATOR_COORD - y; 
 	}
 
+	//
+	// Batch projection
+	// 
+	// latLongToMercatorSVG(lat[], lon[], x[], y[], n) gives the same 
+	// results as calling the single point version n times, but works on
+	// 2 (SSE2) or 4 (AVX2) points at a time.  The widest the CPU supports 
+	// is picked at runtime, so the program itself can be built for a 
+	// baseline x64.
+	// 
+	// There's no vector log() or tan(), so the y value is worked out as
+	//		R * ln(tan(pi/4 + lat/2)) == R/2 * ln((1 + sin(lat)) / (1 - sin(lat)))
+	// with sin() and ln() done with polynomials, and no branches.  Near 
+	// the poles, 1 - sin(lat) is worked out directly, as (1 - cos) of the
+	// complement, so it doesn't lose precision to cancellation.
+	// 
+	// The scalar, SSE2, and AVX2 kernels do exactly the same operations 
+	// in the same order, so they agree bit for bit with each other.  
+	// That needs the multiplies and adds to stay separate, so contraction
+	// into FMA instructions is turned off for the kernels, even when the
+	// program is built with -march=native or -ffp-contract=fast.  
+	// Against the single point version, for latitudes within the Web 
+	// Mercator range (+-85.0511), x is identical, and y is within 
+	// kMercatorBatchMaxUlps ulps of MAX_WEB_MERCATOR_COORD (about 3.7 
+	// nanometers each).  Measuring at that scale, rather than at the 
+	// value itself, is what makes sense for a coordinate that's an offset 
+	// from the edge of the map.  Most of that difference is the single
+	// point version's own error, as tan() is badly conditioned near the
+	// poles; against an exact result the batch is within 4 ulps, the 
+	// single point version within 7.  Latitudes need to be inside 
+	// (-90, 90), they are not wrapped.
+	//
+	// Usage:
+	//	latLongToMercatorSVG(lats.data(), lons.data(), xs.data(), ys.data(), lats.size());
+	//
+
+	static constexpr int kMercatorBatchMaxUlps = 10;
+
+	enum class MercatorKernel
+	{
+		Auto,
+		Scalar,
+		SSE2,
+		AVX2
+	};
+
+	static constexpr double kMercatorPiOver2 = 1.57079632679489661923;
+	static constexpr double kMercatorPiOver4 = 0.78539816339744830962;
+	static constexpr double kMercatorHalfR = 0.5 * 6378137.0;		// EARTH_RADIUS / 2
+
+	// sin() and cos() on [-pi/4, pi/4] (from Cephes)
+	static constexpr double kMercatorSin[6] = {
+		1.58962301576546568060E-10, -2.50507477628578072866E-8, 2.75573136213857245213E-6,
+		-1.98412698295895385996E-4, 8.33333333332211858878E-3, -1.66666666666666307295E-1 };
+	static constexpr double kMercatorCos[6] = {
+		-1.13585365213876817300E-11, 2.08757008419747316778E-9, -2.75573141792967388112E-7,
+		2.48015872888517045348E-5, -1.38888888888730564116E-3, 4.16666666666665929218E-2 };
+
+	// ln(m) = 2 * atanh(f), f = (m - 1)/(m + 1), |f| < 0.172, as the series
+	// 2 * (f + f^3/3 + f^5/5 ...), enough terms for a double
+	static constexpr double kMercatorLog[11] = {
+		2.0 / 23, 2.0 / 21, 2.0 / 19, 2.0 / 17, 2.0 / 15, 2.0 / 13, 2.0 / 11, 2.0 / 9, 2.0 / 7, 2.0 / 5, 2.0 / 3 };
+
+	// ln(2), split so that e * kMercatorLn2Hi is exact
+	static constexpr double kMercatorLn2Hi = 6.93147180369123816490e-01;
+	static constexpr double kMercatorLn2Lo = 1.90821492927058770002e-10;
+
+	static constexpr uint64_t kMercatorMantissaMask = 0x000FFFFFFFFFFFFFull;
+	static constexpr uint64_t kMercatorOneBits = 0x3FF0000000000000ull;
+	static constexpr uint64_t kMercatorTwo52Bits = 0x4330000000000000ull;		// 2^52
+	static constexpr double kMercatorExpBias = 4503599627371519.0;				// 2^52 + 1023
+
+	static INLINE double mercatorBitsToDouble(uint64_t b) { double d; memcpy(&d, &b, sizeof(d)); return d; }
+	static INLINE uint64_t mercatorDoubleToBits(double d) { uint64_t b; memcpy(&b, &d, sizeof(b)); return b; }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+	// The scalar kernel, written the same way as the vector ones
+	static INLINE void mercatorSVGKernel(double lat, double lon, double& x, double& y) noexcept
+	{
+		WAAVS_FP_CONTRACT_OFF
+		x = ((lon * EARTH_RADIUS) * waavs::pi) / 180.0 + MAX_WEB_MERCATOR_COORD;
+
+		double phi = lat * (waavs::pi / 180.0);
+		double a = std::fabs(phi);
+		a = a < kMercatorPiOver2 ? a : kMercatorPiOver2;
+
+		bool nearPole = a > kMercatorPiOver4;
+		double r = nearPole ? (kMercatorPiOver2 - a) : a;
+		double z = r * r;
+
+		double ps = kMercatorSin[0];
+		double pc = kMercatorCos[0];
+		for (int i = 1; i < 6; i++)
+		{
+			ps = (ps * z) + kMercatorSin[i];
+			pc = (pc * z) + kMercatorCos[i];
+		}
+		double sinR = r + ((r * z) * ps);
+		double oneMinusCosR = z * (0.5 - (z * pc));
+
+		double oneMinus = nearPole ? oneMinusCosR : (1.0 - sinR);
+		double onePlus = nearPole ? (2.0 - oneMinusCosR) : (1.0 + sinR);
+		double q = onePlus / oneMinus;
+
+		// ln(q) with q >= 1
+		uint64_t bits = mercatorDoubleToBits(q);
+		double e = mercatorBitsToDouble((bits >> 52) | kMercatorTwo52Bits) - kMercatorExpBias;
+		double m = mercatorBitsToDouble((bits & kMercatorMantissaMask) | kMercatorOneBits);
+		bool big = m > waavs::Sqrt2;
+		m = big ? (m * 0.5) : m;
+		e = big ? (e + 1.0) : e;
+
+		double f = (m - 1.0) / (m + 1.0);
+		double f2 = f * f;
+		double pl = kMercatorLog[0];
+		for (int i = 1; i < 11; i++)
+			pl = (pl * f2) + kMercatorLog[i];
+		double lnm = (f * 2.0) + ((f * f2) * pl);
+		double lnq = (e * kMercatorLn2Hi) + ((e * kMercatorLn2Lo) + lnm);
+
+		double ym = kMercatorHalfR * lnq;
+		y = MAX_WEB_MERCATOR_COORD - (phi < 0 ? -ym : ym);
+	}
+
+#if defined(WAAVS_MERCATOR_X86)
+	static bool cpuHasAVX2() noexcept
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// the OS has to be saving the AVX registers too
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || ((_xgetbv(0) & 6) != 6))
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	static void latLongToMercatorSVG_SSE2(const double* lat, const double* lon, double* x, double* y, size_t n) noexcept
+	{
+		WAAVS_FP_CONTRACT_OFF
+		const __m128d vR = _mm_set1_pd(EARTH_RADIUS);
+		const __m128d vPi = _mm_set1_pd(waavs::pi);
+		const __m128d v180 = _mm_set1_pd(180.0);
+		const __m128d vMax = _mm_set1_pd(MAX_WEB_MERCATOR_COORD);
+		const __m128d vDegToRad = _mm_set1_pd(waavs::pi / 180.0);
+		const __m128d vSign = _mm_set1_pd(-0.0);
+		const __m128d vPiOver2 = _mm_set1_pd(kMercatorPiOver2);
+		const __m128d vPiOver4 = _mm_set1_pd(kMercatorPiOver4);
+		const __m128d vOne = _mm_set1_pd(1.0);
+		const __m128d vTwo = _mm_set1_pd(2.0);
+		const __m128d vHalf = _mm_set1_pd(0.5);
+		const __m128d vSqrt2 = _mm_set1_pd(waavs::Sqrt2);
+		const __m128i vMantMask = _mm_set1_epi64x((long long)kMercatorMantissaMask);
+		const __m128i vOneBits = _mm_set1_epi64x((long long)kMercatorOneBits);
+		const __m128i vTwo52 = _mm_set1_epi64x((long long)kMercatorTwo52Bits);
+		const __m128d vExpBias = _mm_set1_pd(kMercatorExpBias);
+
+		size_t i = 0;
+		for (; i + 2 <= n; i += 2)
+		{
+			__m128d vLon = _mm_loadu_pd(lon + i);
+			__m128d vx = _mm_add_pd(_mm_div_pd(_mm_mul_pd(_mm_mul_pd(vLon, vR), vPi), v180), vMax);
+			_mm_storeu_pd(x + i, vx);
+
+			__m128d phi = _mm_mul_pd(_mm_loadu_pd(lat + i), vDegToRad);
+			__m128d a = _mm_min_pd(_mm_andnot_pd(vSign, phi), vPiOver2);
+
+			__m128d nearPole = _mm_cmpgt_pd(a, vPiOver4);
+			__m128d r = _mm_or_pd(_mm_and_pd(nearPole, _mm_sub_pd(vPiOver2, a)), _mm_andnot_pd(nearPole, a));
+			__m128d z = _mm_mul_pd(r, r);
+
+			__m128d ps = _mm_set1_pd(kMercatorSin[0]);
+			__m128d pc = _mm_set1_pd(kMercatorCos[0]);
+			for (int k = 1; k < 6; k++)
+			{
+				ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(kMercatorSin[k]));
+				pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(kMercatorCos[k]));
+			}
+			__m128d sinR = _mm_add_pd(r, _mm_mul_pd(_mm_mul_pd(r, z), ps));
+			__m128d omc = _mm_mul_pd(z, _mm_sub_pd(vHalf, _mm_mul_pd(z, pc)));
+
+			__m128d oneMinus = _mm_or_pd(_mm_and_pd(nearPole, omc), _mm_andnot_pd(nearPole, _mm_sub_pd(vOne, sinR)));
+			__m128d onePlus = _mm_or_pd(_mm_and_pd(nearPole, _mm_sub_pd(vTwo, omc)), _mm_andnot_pd(nearPole, _mm_add_pd(vOne, sinR)));
+			__m128d q = _mm_div_pd(onePlus, oneMinus);
+
+			__m128i bits = _mm_castpd_si128(q);
+			__m128d e = _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(bits, 52), vTwo52)), vExpBias);
+			__m128d m = _mm_castsi128_pd(_mm_or_si128(_mm_and_si128(bits, vMantMask), vOneBits));
+			__m128d big = _mm_cmpgt_pd(m, vSqrt2);
+			m = _mm_or_pd(_mm_and_pd(big, _mm_mul_pd(m, vHalf)), _mm_andnot_pd(big, m));
+			e = _mm_or_pd(_mm_and_pd(big, _mm_add_pd(e, vOne)), _mm_andnot_pd(big, e));
+
+			__m128d f = _mm_div_pd(_mm_sub_pd(m, vOne), _mm_add_pd(m, vOne));
+			__m128d f2 = _mm_mul_pd(f, f);
+			__m128d pl = _mm_set1_pd(kMercatorLog[0]);
+			for (int k = 1; k < 11; k++)
+				pl = _mm_add_pd(_mm_mul_pd(pl, f2), _mm_set1_pd(kMercatorLog[k]));
+			__m128d lnm = _mm_add_pd(_mm_mul_pd(f, vTwo), _mm_mul_pd(_mm_mul_pd(f, f2), pl));
+			__m128d lnq = _mm_add_pd(_mm_mul_pd(e, _mm_set1_pd(kMercatorLn2Hi)), _mm_add_pd(_mm_mul_pd(e, _mm_set1_pd(kMercatorLn2Lo)), lnm));
+
+			// put the sign of the latitude back on
+			__m128d ym = _mm_xor_pd(_mm_mul_pd(_mm_set1_pd(kMercatorHalfR), lnq), _mm_and_pd(vSign, phi));
+			_mm_storeu_pd(y + i, _mm_sub_pd(vMax, ym));
+		}
+
+		for (; i < n; i++)
+			mercatorSVGKernel(lat[i], lon[i], x[i], y[i]);
+	}
+
+	WAAVS_TARGET_AVX2
+	static void latLongToMercatorSVG_AVX2(const double* lat, const double* lon, double* x, double* y, size_t n) noexcept
+	{
+		WAAVS_FP_CONTRACT_OFF
+		const __m256d vR = _mm256_set1_pd(EARTH_RADIUS);
+		const __m256d vPi = _mm256_set1_pd(waavs::pi);
+		const __m256d v180 = _mm256_set1_pd(180.0);
+		const __m256d vMax = _mm256_set1_pd(MAX_WEB_MERCATOR_COORD);
+		const __m256d vDegToRad = _mm256_set1_pd(waavs::pi / 180.0);
+		const __m256d vSign = _mm256_set1_pd(-0.0);
+		const __m256d vPiOver2 = _mm256_set1_pd(kMercatorPiOver2);
+		const __m256d vPiOver4 = _mm256_set1_pd(kMercatorPiOver4);
+		const __m256d vOne = _mm256_set1_pd(1.0);
+		const __m256d vTwo = _mm256_set1_pd(2.0);
+		const __m256d vHalf = _mm256_set1_pd(0.5);
+		const __m256d vSqrt2 = _mm256_set1_pd(waavs::Sqrt2);
+		const __m256i vMantMask = _mm256_set1_epi64x((long long)kMercatorMantissaMask);
+		const __m256i vOneBits = _mm256_set1_epi64x((long long)kMercatorOneBits);
+		const __m256i vTwo52 = _mm256_set1_epi64x((long long)kMercatorTwo52Bits);
+		const __m256d vExpBias = _mm256_set1_pd(kMercatorExpBias);
+
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			__m256d vLon = _mm256_loadu_pd(lon + i);
+			__m256d vx = _mm256_add_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_mul_pd(vLon, vR), vPi), v180), vMax);
+			_mm256_storeu_pd(x + i, vx);
+
+			__m256d phi = _mm256_mul_pd(_mm256_loadu_pd(lat + i), vDegToRad);
+			__m256d a = _mm256_min_pd(_mm256_andnot_pd(vSign, phi), vPiOver2);
+
+			__m256d nearPole = _mm256_cmp_pd(a, vPiOver4, _CMP_GT_OQ);
+			__m256d r = _mm256_blendv_pd(a, _mm256_sub_pd(vPiOver2, a), nearPole);
+			__m256d z = _mm256_mul_pd(r, r);
+
+			__m256d ps = _mm256_set1_pd(kMercatorSin[0]);
+			__m256d pc = _mm256_set1_pd(kMercatorCos[0]);
+			for (int k = 1; k < 6; k++)
+			{
+				ps = _mm256_add_pd(_mm256_mul_pd(ps, z), _mm256_set1_pd(kMercatorSin[k]));
+				pc = _mm256_add_pd(_mm256_mul_pd(pc, z), _mm256_set1_pd(kMercatorCos[k]));
+			}
+			__m256d sinR = _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(r, z), ps));
+			__m256d omc = _mm256_mul_pd(z, _mm256_sub_pd(vHalf, _mm256_mul_pd(z, pc)));
+
+			__m256d oneMinus = _mm256_blendv_pd(_mm256_sub_pd(vOne, sinR), omc, nearPole);
+			__m256d onePlus = _mm256_blendv_pd(_mm256_add_pd(vOne, sinR), _mm256_sub_pd(vTwo, omc), nearPole);
+			__m256d q = _mm256_div_pd(onePlus, oneMinus);
+
+			__m256i bits = _mm256_castpd_si256(q);
+			__m256d e = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52), vTwo52)), vExpBias);
+			__m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, vMantMask), vOneBits));
+			__m256d big = _mm256_cmp_pd(m, vSqrt2, _CMP_GT_OQ);
+			m = _mm256_blendv_pd(m, _mm256_mul_pd(m, vHalf), big);
+			e = _mm256_blendv_pd(e, _mm256_add_pd(e, vOne), big);
+
+			__m256d f = _mm256_div_pd(_mm256_sub_pd(m, vOne), _mm256_add_pd(m, vOne));
+			__m256d f2 = _mm256_mul_pd(f, f);
+			__m256d pl = _mm256_set1_pd(kMercatorLog[0]);
+			for (int k = 1; k < 11; k++)
+				pl = _mm256_add_pd(_mm256_mul_pd(pl, f2), _mm256_set1_pd(kMercatorLog[k]));
+			__m256d lnm = _mm256_add_pd(_mm256_mul_pd(f, vTwo), _mm256_mul_pd(_mm256_mul_pd(f, f2), pl));
+			__m256d lnq = _mm256_add_pd(_mm256_mul_pd(e, _mm256_set1_pd(kMercatorLn2Hi)), _mm256_add_pd(_mm256_mul_pd(e, _mm256_set1_pd(kMercatorLn2Lo)), lnm));
+
+			__m256d ym = _mm256_xor_pd(_mm256_mul_pd(_mm256_set1_pd(kMercatorHalfR), lnq), _mm256_and_pd(vSign, phi));
+			_mm256_storeu_pd(y + i, _mm256_sub_pd(vMax, ym));
+		}
+
+		for (; i < n; i++)
+			mercatorSVGKernel(lat[i], lon[i], x[i], y[i]);
+	}
+#endif
+
+	// The kernel Auto picks on this machine
+	static MercatorKernel mercatorKernel() noexcept
+	{
+#if defined(WAAVS_MERCATOR_X86)
+		static const MercatorKernel best = cpuHasAVX2() ? MercatorKernel::AVX2 : MercatorKernel::SSE2;
+		return best;
+#else
+		return MercatorKernel::Scalar;
+#endif
+	}
+
+	// Project n points, from separate latitude and longitude arrays
+	static void latLongToMercatorSVG(const double* lat, const double* lon, double* x, double* y, size_t n, MercatorKernel kernel = MercatorKernel::Auto) noexcept
+	{
+		if (kernel == MercatorKernel::Auto)
+			kernel = mercatorKernel();
+
+#if defined(WAAVS_MERCATOR_X86)
+		if (kernel == MercatorKernel::AVX2 && mercatorKernel() == MercatorKernel::AVX2)
+		{
+			latLongToMercatorSVG_AVX2(lat, lon, x, y, n);
+			return;
+		}
+		if (kernel != MercatorKernel::Scalar)
+		{
+			latLongToMercatorSVG_SSE2(lat, lon, x, y, n);
+			return;
+		}
+#endif
+
+		for (size_t i = 0; i < n; i++)
+			mercatorSVGKernel(lat[i], lon[i], x[i], y[i]);
+	}
+
+	//
+	// MercatorApprox
+	// 
+	// A faster, approximate, Web Mercator projection, for when the output
+	// only has to be right to within some number of meters, or pixels, 
+	// such as a preview.
+	// 
+	// The y transform, R * ln(tan(pi/4 + lat/2)), is odd, so only 
+	// [0, 85.0511] degrees is fitted.  That range is cut into equal 
+	// segments, each with a polynomial of degree kDegree, fitted by
+	// interpolating at the Chebyshev nodes, which is within a hair of the
+	// minimax polynomial.  The fewest segments that meet the requested 
+	// error are found when the object is constructed, by measuring each 
+	// fit against the exact transform.
+	// 
+	// Evaluating a point is a clamp, a multiply and floor to find the 
+	// segment, then Horner's rule on coefficients looked up from a table.
+	// There are no branches, and the AVX2 kernel does 4 points at a time,
+	// gathering the coefficients.  x is computed exactly, as it's linear.
+	// 
+	// Latitudes beyond the Web Mercator limit are clamped to it.
+	// 
+	// Very small errors can need more than kMaxSegments.  The fit then
+	// stops at kMaxSegments, and meetsError() is false.  fitError() is
+	// what was actually reached, either way.
+	// 
+	// measureError() sweeps the whole latitude range, comparing with the
+	// exact path, and should come back within maxError() whenever
+	// meetsError() is true.  The scalar and AVX2 kernels give the same
+	// bits, as the exact kernels do.  testy/mercapprox checks both.
+	// 
+	// Usage:
+	//	// good to half a pixel, at 0.6m a pixel
+	//	MercatorApprox approx = MercatorApprox::withPixels(0.5, 0.6);
+	//	approx.project(lat, lon, x, y, n);
+	//
+
+	struct MercatorApprox
+	{
+		static constexpr int kDegree = 5;
+		static constexpr int kCoeffs = kDegree + 1;
+		static constexpr int kMaxSegments = 1 << 16;
+		static constexpr double kMaxLatitude = 85.0511287798066;
+
+		double fMaxError{ 0 };			// what was asked for, in meters
+		double fFitError{ 0 };			// what was measured, in meters
+		bool fMeetsError{ false };		// whether fFitError is good enough for fMaxError
+		double fInvWidth{ 0 };			// segments per degree
+		double fLastSegment{ 0 };
+		std::vector<double> fCoeffs{};	// kCoeffs per segment, highest degree first
+
+		MercatorApprox() : MercatorApprox(1.0) {}
+		explicit MercatorApprox(double maxErrorMeters)
+		{
+			fit(maxErrorMeters);
+		}
+
+		static MercatorApprox withMeters(double maxErrorMeters) { return MercatorApprox(maxErrorMeters); }
+
+		// The error as a number of output pixels, given how many meters 
+		// (of Web Mercator y) each pixel covers
+		static MercatorApprox withPixels(double maxErrorPixels, double metersPerPixel)
+		{
+			return MercatorApprox(maxErrorPixels * metersPerPixel);
+		}
+
+		double maxError() const { return fMaxError; }
+		double fitError() const { return fFitError; }
+		bool meetsError() const { return fMeetsError; }
+		size_t numSegments() const { return fCoeffs.size() / kCoeffs; }
+
+		// The exact (Web Mercator, not SVG) y, in meters, for a latitude in degrees
+		static double exactY(double lat)
+		{
+			return EARTH_RADIUS * std::log(std::tan(waavs::pi / 4.0 + lat * (waavs::pi / 180.0) / 2.0));
+		}
+
+		// Fit the fewest segments that meet the error, doubling the 
+		// count until they do, or until kMaxSegments
+		// Returns false if kMaxSegments wasn't enough.
+		bool fit(double maxErrorMeters)
+		{
+			fMaxError = maxErrorMeters;
+
+			// leave some room for error between the sample points
+			double target = maxErrorMeters * 0.5;
+
+			for (int segments = 4; ; segments *= 2)
+			{
+				fitSegments(segments);
+				if (fFitError <= target || segments >= kMaxSegments)
+					break;
+			}
+
+			fMeetsError = fFitError <= target;
+			return fMeetsError;
+		}
+
+		// The approximate y, flipped for SVG like latLongToMercatorSVG()
+		INLINE double svgY(double lat) const
+		{
+			WAAVS_FP_CONTRACT_OFF
+			double a = std::fabs(lat);
+			a = a < kMaxLatitude ? a : kMaxLatitude;
+
+			double u = a * fInvWidth;
+			double s = std::floor(u);
+			s = s < fLastSegment ? s : fLastSegment;
+			double t = ((u - s) * 2.0) - 1.0;
+
+			const double* c = fCoeffs.data() + ((size_t)s * kCoeffs);
+			double p = c[0];
+			for (int k = 1; k < kCoeffs; k++)
+				p = (p * t) + c[k];
+
+			// the sign bit, as the AVX2 kernel uses, so -0.0 agrees
+			return MAX_WEB_MERCATOR_COORD - (std::signbit(lat) ? -p : p);
+		}
+
+		INLINE void projectPoint(double lat, double lon, double& x, double& y) const
+		{
+			x = ((lon * EARTH_RADIUS) * waavs::pi) / 180.0 + MAX_WEB_MERCATOR_COORD;
+			y = svgY(lat);
+		}
+
+		// Only the scalar and AVX2 kernels exist, SSE2 means scalar
+		void project(const double* lat, const double* lon, double* x, double* y, size_t n, MercatorKernel kernel = MercatorKernel::Auto) const
+		{
+			if (kernel == MercatorKernel::Auto)
+				kernel = mercatorKernel();
+
+			size_t i = 0;
+#if defined(WAAVS_MERCATOR_X86)
+			if (kernel == MercatorKernel::AVX2 && mercatorKernel() == MercatorKernel::AVX2)
+				i = projectAVX2(lat, lon, x, y, n);
+#endif
+			for (; i < n; i++)
+				projectPoint(lat[i], lon[i], x[i], y[i]);
+		}
+
+		// Largest difference from the exact y, in meters, over 'samples'
+		// latitudes spread across the whole range
+		double measureError(size_t samples = 1000000) const
+		{
+			double worst = 0;
+			for (size_t i = 0; i <= samples; i++)
+			{
+				double lat = -kMaxLatitude + ((2 * kMaxLatitude) * (double)i / (double)samples);
+				double err = std::fabs(svgY(lat) - (MAX_WEB_MERCATOR_COORD - exactY(lat)));
+				worst = err > worst ? err : worst;
+			}
+
+			return worst;
+		}
+
+	private:
+		void fitSegments(int segments)
+		{
+			double width = kMaxLatitude / segments;
+			fInvWidth = segments / kMaxLatitude;
+			fLastSegment = segments - 1;
+			fCoeffs.assign((size_t)segments * kCoeffs, 0.0);
+			fFitError = 0;
+
+			for (int s = 0; s < segments; s++)
+			{
+				double lo = s * width;
+
+				// values at the Chebyshev nodes
+				double f[kCoeffs];
+				for (int j = 0; j < kCoeffs; j++)
+				{
+					double t = std::cos(waavs::pi * (j + 0.5) / kCoeffs);
+					f[j] = exactY(lo + ((t + 1.0) * 0.5 * width));
+				}
+
+				// Chebyshev coefficients
+				double cheb[kCoeffs];
+				for (int k = 0; k < kCoeffs; k++)
+				{
+					double sum = 0;
+					for (int j = 0; j < kCoeffs; j++)
+						sum += f[j] * std::cos(waavs::pi * k * (j + 0.5) / kCoeffs);
+					cheb[k] = sum * (2.0 / kCoeffs);
+				}
+				cheb[0] *= 0.5;
+
+				// turn the Chebyshev series into a plain polynomial in t
+				// using T(k+1) = 2t T(k) - T(k-1)
+				double poly[kCoeffs] = {};
+				double tPrev[kCoeffs] = { 1 };		// T0
+				double tCur[kCoeffs] = { 0, 1 };	// T1
+				poly[0] = cheb[0];
+				for (int i = 0; i < kCoeffs; i++)
+					poly[i] += cheb[1] * tCur[i];
+				for (int k = 2; k < kCoeffs; k++)
+				{
+					double tNext[kCoeffs] = {};
+					for (int i = 0; i < kCoeffs; i++)
+					{
+						tNext[i] = -tPrev[i];
+						if (i > 0)
+							tNext[i] += 2 * tCur[i - 1];
+					}
+					for (int i = 0; i < kCoeffs; i++)
+					{
+						tPrev[i] = tCur[i];
+						tCur[i] = tNext[i];
+						poly[i] += cheb[k] * tNext[i];
+					}
+				}
+
+				double* c = fCoeffs.data() + ((size_t)s * kCoeffs);
+				for (int i = 0; i < kCoeffs; i++)
+					c[i] = poly[kDegree - i];
+
+				// measure the fit, including the ends of the segment
+				static constexpr int kSamples = 32;
+				for (int j = 0; j <= kSamples; j++)
+				{
+					double t = ((2.0 * j) / kSamples) - 1.0;
+					double p = c[0];
+					for (int k = 1; k < kCoeffs; k++)
+						p = (p * t) + c[k];
+
+					double err = std::fabs(p - exactY(lo + ((t + 1.0) * 0.5 * width)));
+					fFitError = err > fFitError ? err : fFitError;
+				}
+			}
+		}
+
+#if defined(WAAVS_MERCATOR_X86)
+		// Returns how many points were done, a multiple of 4
+		WAAVS_TARGET_AVX2
+		size_t projectAVX2(const double* lat, const double* lon, double* x, double* y, size_t n) const
+		{
+			WAAVS_FP_CONTRACT_OFF
+			const __m256d vR = _mm256_set1_pd(EARTH_RADIUS);
+			const __m256d vPi = _mm256_set1_pd(waavs::pi);
+			const __m256d v180 = _mm256_set1_pd(180.0);
+			const __m256d vMax = _mm256_set1_pd(MAX_WEB_MERCATOR_COORD);
+			const __m256d vSign = _mm256_set1_pd(-0.0);
+			const __m256d vLimit = _mm256_set1_pd(kMaxLatitude);
+			const __m256d vInvWidth = _mm256_set1_pd(fInvWidth);
+			const __m256d vLast = _mm256_set1_pd(fLastSegment);
+			const __m256d vOne = _mm256_set1_pd(1.0);
+			const __m256d vTwo = _mm256_set1_pd(2.0);
+			const __m128i vStride = _mm_set1_epi32(kCoeffs);
+			const double* table = fCoeffs.data();
+
+			// The masked gather, with every lane on, is the same as the
+			// plain one, but GCC can't see that the plain one's source
+			// is never read, and warns -Wmaybe-uninitialized
+			const __m256d vZero = _mm256_setzero_pd();
+			const __m256d vAll = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+			{
+				__m256d vLon = _mm256_loadu_pd(lon + i);
+				_mm256_storeu_pd(x + i, _mm256_add_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_mul_pd(vLon, vR), vPi), v180), vMax));
+
+				__m256d vLat = _mm256_loadu_pd(lat + i);
+				__m256d a = _mm256_min_pd(_mm256_andnot_pd(vSign, vLat), vLimit);
+				__m256d u = _mm256_mul_pd(a, vInvWidth);
+				__m256d s = _mm256_min_pd(_mm256_floor_pd(u), vLast);
+				__m256d t = _mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(u, s), vTwo), vOne);
+
+				__m128i idx = _mm_mullo_epi32(_mm256_cvttpd_epi32(s), vStride);
+				__m256d p = _mm256_mask_i32gather_pd(vZero, table, idx, vAll, 8);
+				for (int k = 1; k < kCoeffs; k++)
+					p = _mm256_add_pd(_mm256_mul_pd(p, t), _mm256_mask_i32gather_pd(vZero, table + k, idx, vAll, 8));
+
+				__m256d ym = _mm256_xor_pd(p, _mm256_and_pd(vSign, vLat));
+				_mm256_storeu_pd(y + i, _mm256_sub_pd(vMax, ym));
+			}
+
+			return i;
+		}
+#endif
+	};
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#endif
 }
 
 /*
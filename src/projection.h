@@ -0,0 +1,1152 @@
+#pragma once
+
+//
+// Map projections
+//
+// A Projection converts between longitude/latitude, in degrees, and
+// the x/y of a coordinate system, in its own linear units (meters,
+// feet, ...), with false easting and northing applied.  They work on
+// whole arrays at a time
+//	forward(lon[], lat[], x[], y[], n)
+//	inverse(x[], y[], lon[], lat[], n)
+// The output arrays may be the same as the input arrays.
+//
+// Everything that only depends on the parameters of the coordinate
+// system (the ellipsoid, series coefficients, cone constants) is worked
+// out once, when the object is constructed, so the per-point work is
+// just the formula itself.
+//
+// Supported
+//	GeographicProjection			GEOGCS, the coordinates are already lon/lat
+//	WebMercatorProjection			Mercator_Auxiliary_Sphere, Pseudo-Mercator
+//	TransverseMercatorProjection	Transverse_Mercator, which covers UTM
+//	AlbersEqualAreaProjection		Albers, Albers_Conic_Equal_Area
+//	LambertConformalConicProjection	Lambert_Conformal_Conic (1SP and 2SP)
+//
+// GridProjection wraps any of them, interpolating from a grid over the
+// area a layer covers, for when there are many points to project and
+// they only need to be right to within some distance.
+//
+// The formulas for the conics are the ellipsoidal ones from Snyder,
+// "Map Projections: A Working Manual".  Transverse Mercator uses the
+// Krüger series, to third order in n, which is good to well under a
+// millimeter within a UTM zone.
+//
+// There's no datum shifting, longitude/latitude are on whatever datum
+// the coordinate system is.  For NAD83 and WGS84 that's within a meter
+// or two, which doesn't show on a map.
+//
+// Usage:
+//	auto proj = Projection::create_shared(wktText);
+//	if (proj && !proj->isGeographic())
+//		proj->inverse(xs, ys, lons, lats, n);
+//
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "bspan.h"
+#include "maths.h"
+#include "wkt.h"
+
+
+namespace waavs {
+	struct Ellipsoid
+	{
+		double a{ 6378137.0 };			// semi-major axis, meters
+		double f{ 0 };					// flattening
+		double e2{ 0 };					// eccentricity squared
+		double e{ 0 };
+
+		Ellipsoid() = default;
+		Ellipsoid(double semiMajor, double inverseFlattening)
+			: a(semiMajor)
+		{
+			f = (inverseFlattening != 0) ? 1.0 / inverseFlattening : 0.0;
+			e2 = f * (2 - f);
+			e = std::sqrt(e2);
+		}
+
+		static Ellipsoid wgs84() { return Ellipsoid(6378137.0, 298.257223563); }
+		static Ellipsoid grs80() { return Ellipsoid(6378137.0, 298.257222101); }
+
+		bool isSphere() const { return e2 == 0; }
+	};
+
+	// The parameters of a coordinate system, as they come from the WKT
+	// Angles are in degrees, lengths in the linear unit.
+	struct ProjectionParams
+	{
+		Ellipsoid fEllipsoid{};
+		double fCentralMeridian{ 0 };
+		double fLatitudeOfOrigin{ 0 };
+		double fStandardParallel1{ 0 };
+		double fStandardParallel2{ 0 };
+		bool fHasStandardParallel2{ false };
+		double fScaleFactor{ 1 };
+		double fFalseEasting{ 0 };
+		double fFalseNorthing{ 0 };
+		double fMetersPerUnit{ 1 };			// linear unit
+		double fPrimeMeridian{ 0 };			// degrees east of Greenwich
+		double fDegreesPerUnit{ 1 };		// angular unit of the geographic system
+	};
+
+	struct Projection
+	{
+		ProjectionParams fParams{};
+
+		Projection() = default;
+		Projection(const ProjectionParams& params) : fParams(params) {}
+		virtual ~Projection() = default;
+
+		const ProjectionParams& params() const { return fParams; }
+
+		virtual bool isGeographic() const { return false; }
+
+		// lon/lat in degrees, to x/y
+		virtual void forward(const double* lon, const double* lat, double* x, double* y, size_t n) const = 0;
+
+		// x/y to lon/lat in degrees
+		virtual void inverse(const double* x, const double* y, double* lon, double* lat, size_t n) const = 0;
+
+		// Build the projection a WKT coordinate system describes
+		// Returns nullptr if it's not one of the supported ones
+		static std::shared_ptr<Projection> create_shared(const WktNode& root);
+		static std::shared_ptr<Projection> create_shared(const std::string& wkt)
+		{
+			WktNode root;
+			ByteSpan s(wkt.data(), wkt.size());
+			if (!root.readFromStream(s))
+				return nullptr;
+
+			return create_shared(root);
+		}
+	};
+
+	// Longitude difference, in radians, brought into -PI..PI
+	static INLINE double projWrapLon(double lam)
+	{
+		if (lam > waavs::pi || lam < -waavs::pi)
+			lam -= waavs::Pi2 * std::floor((lam + waavs::pi) * waavs::Inv2Pi);
+		return lam;
+	}
+
+	// Helpers shared by the conics
+	// m(phi) = cos(phi) / sqrt(1 - e^2 sin^2(phi))
+	static INLINE double projM(double e2, double phi)
+	{
+		double s = std::sin(phi);
+		return std::cos(phi) / std::sqrt(1.0 - (e2 * s * s));
+	}
+
+	//
+	// GeographicProjection
+	// The coordinates are longitude/latitude already, possibly in some
+	// angular unit other than degrees, or from another prime meridian.
+	//
+	struct GeographicProjection : public Projection
+	{
+		double fToDegrees{ 1 };
+		double fFromDegrees{ 1 };
+		double fMeridian{ 0 };
+
+		GeographicProjection(const ProjectionParams& params = ProjectionParams())
+			: Projection(params)
+		{
+			fToDegrees = params.fDegreesPerUnit;
+			fFromDegrees = 1.0 / params.fDegreesPerUnit;
+			fMeridian = params.fPrimeMeridian;
+		}
+
+		bool isGeographic() const override { return true; }
+
+		void forward(const double* lon, const double* lat, double* x, double* y, size_t n) const override
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				x[i] = (lon[i] - fMeridian) * fFromDegrees;
+				y[i] = lat[i] * fFromDegrees;
+			}
+		}
+
+		void inverse(const double* x, const double* y, double* lon, double* lat, size_t n) const override
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				lon[i] = (x[i] * fToDegrees) + fMeridian;
+				lat[i] = y[i] * fToDegrees;
+			}
+		}
+	};
+
+	//
+	// WebMercatorProjection
+	// Spherical Mercator, on a sphere the size of the semi-major axis,
+	// as used by web maps (EPSG:3857)
+	//
+	struct WebMercatorProjection : public Projection
+	{
+		double fR{ 6378137.0 };
+		double fInvR{ 1.0 / 6378137.0 };
+		double fLon0{ 0 };
+		double fFE{ 0 };
+		double fFN{ 0 };
+		double fToUnit{ 1 };
+		double fToMeters{ 1 };
+
+		WebMercatorProjection(const ProjectionParams& params = ProjectionParams())
+			: Projection(params)
+		{
+			fR = params.fEllipsoid.a;
+			fInvR = 1.0 / fR;
+			fLon0 = (params.fCentralMeridian + params.fPrimeMeridian) * waavs::DegToRad;
+			fToMeters = params.fMetersPerUnit;
+			fToUnit = 1.0 / params.fMetersPerUnit;
+			fFE = params.fFalseEasting * fToMeters;
+			fFN = params.fFalseNorthing * fToMeters;
+		}
+
+		void forward(const double* lon, const double* lat, double* x, double* y, size_t n) const override
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				double lam = (lon[i] * waavs::DegToRad) - fLon0;
+				double phi = lat[i] * waavs::DegToRad;
+				x[i] = ((fR * lam) + fFE) * fToUnit;
+				y[i] = ((fR * std::atanh(std::sin(phi))) + fFN) * fToUnit;
+			}
+		}
+
+		void inverse(const double* x, const double* y, double* lon, double* lat, size_t n) const override
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				double e = ((x[i] * fToMeters) - fFE) * fInvR;
+				double nn = ((y[i] * fToMeters) - fFN) * fInvR;
+				lon[i] = (e + fLon0) * waavs::RadToDeg;
+				lat[i] = std::atan(std::sinh(nn)) * waavs::RadToDeg;
+			}
+		}
+	};
+
+	//
+	// TransverseMercatorProjection
+	// Krüger's series, in the form given by Karney (2011)
+	//
+	struct TransverseMercatorProjection : public Projection
+	{
+		double fE{ 0 };
+		double fK0A{ 0 };			// scale factor * rectifying radius
+		double fInvK0A{ 0 };
+		double fXi0{ 0 };			// xi of the latitude of origin
+		double fLon0{ 0 };
+		double fFE{ 0 };
+		double fFN{ 0 };
+		double fToUnit{ 1 };
+		double fToMeters{ 1 };
+		double fAlpha[3]{};
+		double fBeta[3]{};
+		double fDelta[3]{};
+
+		TransverseMercatorProjection(const ProjectionParams& params = ProjectionParams())
+			: Projection(params)
+		{
+			const Ellipsoid& el = params.fEllipsoid;
+			double n = el.f / (2 - el.f);
+			double n2 = n * n;
+			double n3 = n2 * n;
+
+			fE = el.e;
+			double A = (el.a / (1 + n)) * (1 + (n2 / 4) + (n2 * n2 / 64));
+			fK0A = params.fScaleFactor * A;
+			fInvK0A = 1.0 / fK0A;
+
+			fAlpha[0] = (n / 2) - (2 * n2 / 3) + (5 * n3 / 16);
+			fAlpha[1] = (13 * n2 / 48) - (3 * n3 / 5);
+			fAlpha[2] = (61 * n3 / 240);
+
+			fBeta[0] = (n / 2) - (2 * n2 / 3) + (37 * n3 / 96);
+			fBeta[1] = (n2 / 48) + (n3 / 15);
+			fBeta[2] = (17 * n3 / 480);
+
+			fDelta[0] = (2 * n) - (2 * n2 / 3) - (2 * n3);
+			fDelta[1] = (7 * n2 / 3) - (8 * n3 / 5);
+			fDelta[2] = (56 * n3 / 15);
+
+			fLon0 = (params.fCentralMeridian + params.fPrimeMeridian) * waavs::DegToRad;
+			fToMeters = params.fMetersPerUnit;
+			fToUnit = 1.0 / params.fMetersPerUnit;
+			fFE = params.fFalseEasting * fToMeters;
+			fFN = params.fFalseNorthing * fToMeters;
+
+			double eta0 = 0;
+			forwardPoint(0, params.fLatitudeOfOrigin * waavs::DegToRad, fXi0, eta0);
+		}
+
+		// The UTM zone, 1 to 60, on the given ellipsoid
+		static std::shared_ptr<TransverseMercatorProjection> utm(int zone, bool north, const Ellipsoid& el = Ellipsoid::wgs84())
+		{
+			ProjectionParams p;
+			p.fEllipsoid = el;
+			p.fCentralMeridian = (zone * 6.0) - 183.0;
+			p.fScaleFactor = 0.9996;
+			p.fFalseEasting = 500000.0;
+			p.fFalseNorthing = north ? 0.0 : 10000000.0;
+			return std::make_shared<TransverseMercatorProjection>(p);
+		}
+
+		// xi and eta, before scaling, for lam relative to the central meridian
+		INLINE void forwardPoint(double lam, double phi, double& xi, double& eta) const
+		{
+			double s = std::sin(phi);
+			double t = std::sinh(std::atanh(s) - (fE * std::atanh(fE * s)));
+			double cl = std::cos(lam);
+			double xiP = std::atan2(t, cl);
+			double etaP = std::atanh(std::sin(lam) / std::sqrt(1 + (t * t)));
+
+			xi = xiP;
+			eta = etaP;
+			for (int j = 0; j < 3; j++)
+			{
+				double k = 2.0 * (j + 1);
+				xi += fAlpha[j] * std::sin(k * xiP) * std::cosh(k * etaP);
+				eta += fAlpha[j] * std::cos(k * xiP) * std::sinh(k * etaP);
+			}
+		}
+
+		void forward(const double* lon, const double* lat, double* x, double* y, size_t n) const override
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				double xi, eta;
+				forwardPoint((lon[i] * waavs::DegToRad) - fLon0, lat[i] * waavs::DegToRad, xi, eta);
+				x[i] = ((fK0A * eta) + fFE) * fToUnit;
+				y[i] = ((fK0A * (xi - fXi0)) + fFN) * fToUnit;
+			}
+		}
+
+		void inverse(const double* x, const double* y, double* lon, double* lat, size_t n) const override
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				double xi = (((y[i] * fToMeters) - fFN) * fInvK0A) + fXi0;
+				double eta = ((x[i] * fToMeters) - fFE) * fInvK0A;
+
+				double xiP = xi;
+				double etaP = eta;
+				for (int j = 0; j < 3; j++)
+				{
+					double k = 2.0 * (j + 1);
+					xiP -= fBeta[j] * std::sin(k * xi) * std::cosh(k * eta);
+					etaP -= fBeta[j] * std::cos(k * xi) * std::sinh(k * eta);
+				}
+
+				double chi = std::asin(std::sin(xiP) / std::cosh(etaP));
+				double phi = chi;
+				for (int j = 0; j < 3; j++)
+					phi += fDelta[j] * std::sin(2.0 * (j + 1) * chi);
+
+				// The series leaves it good to a fraction of a millimeter,
+				// one fixed point step on the conformal latitude finishes it
+				phi = std::asin(std::tanh(std::atanh(std::sin(chi)) + (fE * std::atanh(fE * std::sin(phi)))));
+
+				lon[i] = (fLon0 + std::atan2(std::sinh(etaP), std::cos(xiP))) * waavs::RadToDeg;
+				lat[i] = phi * waavs::RadToDeg;
+			}
+		}
+	};
+
+	//
+	// AlbersEqualAreaProjection
+	// Snyder, equations 14-3 to 14-21
+	//
+	struct AlbersEqualAreaProjection : public Projection
+	{
+		double fA{ 0 };
+		double fE{ 0 };
+		double fE2{ 0 };
+		double fN{ 0 };
+		double fC{ 0 };
+		double fRho0{ 0 };
+		double fLon0{ 0 };
+		double fFE{ 0 };
+		double fFN{ 0 };
+		double fToUnit{ 1 };
+		double fToMeters{ 1 };
+
+		AlbersEqualAreaProjection(const ProjectionParams& params)
+			: Projection(params)
+		{
+			const Ellipsoid& el = params.fEllipsoid;
+			fA = el.a;
+			fE = el.e;
+			fE2 = el.e2;
+
+			double phi0 = params.fLatitudeOfOrigin * waavs::DegToRad;
+			double phi1 = params.fStandardParallel1 * waavs::DegToRad;
+			double phi2 = (params.fHasStandardParallel2 ? params.fStandardParallel2 : params.fStandardParallel1) * waavs::DegToRad;
+
+			double m1 = projM(fE2, phi1);
+			double m2 = projM(fE2, phi2);
+			double q0 = q(phi0);
+			double q1 = q(phi1);
+			double q2 = q(phi2);
+
+			fN = (std::fabs(phi1 - phi2) > 1e-10) ? ((m1 * m1) - (m2 * m2)) / (q2 - q1) : std::sin(phi1);
+			fC = (m1 * m1) + (fN * q1);
+			fRho0 = fA * std::sqrt(fC - (fN * q0)) / fN;
+
+			fLon0 = (params.fCentralMeridian + params.fPrimeMeridian) * waavs::DegToRad;
+			fToMeters = params.fMetersPerUnit;
+			fToUnit = 1.0 / params.fMetersPerUnit;
+			fFE = params.fFalseEasting * fToMeters;
+			fFN = params.fFalseNorthing * fToMeters;
+		}
+
+		// Snyder 3-12
+		INLINE double q(double phi) const
+		{
+			double s = std::sin(phi);
+			if (fE == 0)
+				return 2 * s;
+
+			double es = fE * s;
+			return (1 - fE2) * ((s / (1 - (es * es))) - ((1 / (2 * fE)) * std::log((1 - es) / (1 + es))));
+		}
+
+		void forward(const double* lon, const double* lat, double* x, double* y, size_t n) const override
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				double phi = lat[i] * waavs::DegToRad;
+				double theta = fN * projWrapLon((lon[i] * waavs::DegToRad) - fLon0);
+				double rho = fA * std::sqrt(fC - (fN * q(phi))) / fN;
+
+				x[i] = ((rho * std::sin(theta)) + fFE) * fToUnit;
+				y[i] = ((fRho0 - (rho * std::cos(theta))) + fFN) * fToUnit;
+			}
+		}
+
+		void inverse(const double* x, const double* y, double* lon, double* lat, size_t n) const override
+		{
+			double qPole = q(waavs::PiOver2);
+
+			for (size_t i = 0; i < n; i++)
+			{
+				double dx = (x[i] * fToMeters) - fFE;
+				double dy = fRho0 - ((y[i] * fToMeters) - fFN);
+				if (fN < 0)
+				{
+					dx = -dx;
+					dy = -dy;
+				}
+
+				double rho = std::sqrt((dx * dx) + (dy * dy));
+				double theta = std::atan2(dx, dy);
+				double qq = (fC - ((rho * rho * fN * fN) / (fA * fA))) / fN;
+
+				// Snyder 3-16, iterated from the spherical answer
+				double phi;
+				if (std::fabs(qq) >= std::fabs(qPole))
+				{
+					phi = qq < 0 ? -waavs::PiOver2 : waavs::PiOver2;
+				}
+				else {
+					double ratio = qq / 2;
+					phi = std::asin(ratio < -1 ? -1 : (ratio > 1 ? 1 : ratio));
+					if (fE != 0)
+					{
+						for (int iter = 0; iter < 15; iter++)
+						{
+							double s = std::sin(phi);
+							double es = fE * s;
+							double one = 1 - (es * es);
+							double dphi = ((one * one) / (2 * std::cos(phi))) *
+								((qq / (1 - fE2)) - (s / one) + ((1 / (2 * fE)) * std::log((1 - es) / (1 + es))));
+							phi += dphi;
+							if (std::fabs(dphi) < 1e-12)
+								break;
+						}
+					}
+				}
+
+				lon[i] = (fLon0 + (theta / fN)) * waavs::RadToDeg;
+				lat[i] = phi * waavs::RadToDeg;
+			}
+		}
+	};
+
+	//
+	// LambertConformalConicProjection
+	// Snyder, equations 15-1 to 15-11, one or two standard parallels
+	//
+	struct LambertConformalConicProjection : public Projection
+	{
+		double fA{ 0 };
+		double fE{ 0 };
+		double fN{ 0 };
+		double fAF{ 0 };			// a * F * k0
+		double fRho0{ 0 };
+		double fLon0{ 0 };
+		double fFE{ 0 };
+		double fFN{ 0 };
+		double fToUnit{ 1 };
+		double fToMeters{ 1 };
+
+		LambertConformalConicProjection(const ProjectionParams& params)
+			: Projection(params)
+		{
+			const Ellipsoid& el = params.fEllipsoid;
+			fA = el.a;
+			fE = el.e;
+
+			double phi0 = params.fLatitudeOfOrigin * waavs::DegToRad;
+			double k0 = params.fScaleFactor;
+
+			if (params.fHasStandardParallel2)
+			{
+				double phi1 = params.fStandardParallel1 * waavs::DegToRad;
+				double phi2 = params.fStandardParallel2 * waavs::DegToRad;
+				double m1 = projM(el.e2, phi1);
+				double m2 = projM(el.e2, phi2);
+				double t1 = t(phi1);
+				double t2 = t(phi2);
+
+				fN = (std::fabs(phi1 - phi2) > 1e-10) ? (std::log(m1) - std::log(m2)) / (std::log(t1) - std::log(t2)) : std::sin(phi1);
+				fAF = fA * k0 * (m1 / (fN * std::pow(t1, fN)));
+			}
+			else {
+				// one standard parallel, which is the latitude of origin,
+				// where the scale factor applies
+				double m0 = projM(el.e2, phi0);
+				fN = std::sin(phi0);
+				fAF = fA * k0 * (m0 / (fN * std::pow(t(phi0), fN)));
+			}
+
+			fRho0 = fAF * std::pow(t(phi0), fN);
+
+			fLon0 = (params.fCentralMeridian + params.fPrimeMeridian) * waavs::DegToRad;
+			fToMeters = params.fMetersPerUnit;
+			fToUnit = 1.0 / params.fMetersPerUnit;
+			fFE = params.fFalseEasting * fToMeters;
+			fFN = params.fFalseNorthing * fToMeters;
+		}
+
+		// Snyder 15-9
+		INLINE double t(double phi) const
+		{
+			double es = fE * std::sin(phi);
+			return std::tan(waavs::PiOver4 - (phi / 2)) / std::pow((1 - es) / (1 + es), fE / 2);
+		}
+
+		void forward(const double* lon, const double* lat, double* x, double* y, size_t n) const override
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				double phi = lat[i] * waavs::DegToRad;
+				double theta = fN * projWrapLon((lon[i] * waavs::DegToRad) - fLon0);
+				double rho = fAF * std::pow(t(phi), fN);
+
+				x[i] = ((rho * std::sin(theta)) + fFE) * fToUnit;
+				y[i] = ((fRho0 - (rho * std::cos(theta))) + fFN) * fToUnit;
+			}
+		}
+
+		void inverse(const double* x, const double* y, double* lon, double* lat, size_t n) const override
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				double dx = (x[i] * fToMeters) - fFE;
+				double dy = fRho0 - ((y[i] * fToMeters) - fFN);
+				if (fN < 0)
+				{
+					dx = -dx;
+					dy = -dy;
+				}
+
+				double rho = std::sqrt((dx * dx) + (dy * dy));
+				double theta = std::atan2(dx, dy);
+				if (fN < 0)
+					rho = -rho;
+
+				double tt = std::pow(rho / fAF, 1.0 / fN);
+
+				// Snyder 7-9, iterated from the spherical answer
+				double phi = waavs::PiOver2 - (2 * std::atan(tt));
+				for (int iter = 0; iter < 15; iter++)
+				{
+					double es = fE * std::sin(phi);
+					double next = waavs::PiOver2 - (2 * std::atan(tt * std::pow((1 - es) / (1 + es), fE / 2)));
+					double dphi = next - phi;
+					phi = next;
+					if (std::fabs(dphi) < 1e-12)
+						break;
+				}
+
+				lon[i] = (fLon0 + (theta / fN)) * waavs::RadToDeg;
+				lat[i] = phi * waavs::RadToDeg;
+			}
+		}
+	};
+
+	//
+	// Reading the parameters out of the WKT
+	//
+
+	// PARAMETER["name", value], matching either the ESRI or OGC spelling
+	static bool wktParameter(const WktNode& projcs, const char* name, double& value)
+	{
+		for (const WktNode& c : projcs.children())
+		{
+			if (c.is("PARAMETER") && wktEqualNoCase(c.name(), name))
+			{
+				value = c.number(1);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static void wktGeographicParams(const WktNode& geogcs, ProjectionParams& p)
+	{
+		const WktNode* spheroid = geogcs.find("SPHEROID");
+		if (!spheroid)
+			spheroid = geogcs.find("ELLIPSOID");
+		if (spheroid)
+			p.fEllipsoid = Ellipsoid(spheroid->number(1, 6378137.0), spheroid->number(2, 0));
+
+		const WktNode* primem = geogcs.child("PRIMEM");
+		if (primem)
+			p.fPrimeMeridian = primem->number(1);
+
+		// UNIT["Degree", radians per unit]
+		const WktNode* unit = geogcs.child("UNIT");
+		if (unit)
+		{
+			double radians = unit->number(1, waavs::DegToRad);
+			if (radians > 0)
+				p.fDegreesPerUnit = radians * waavs::RadToDeg;
+		}
+	}
+
+	inline std::shared_ptr<Projection> Projection::create_shared(const WktNode& root)
+	{
+		ProjectionParams p;
+
+		if (root.is("GEOGCS") || root.is("GEOGCRS"))
+		{
+			wktGeographicParams(root, p);
+			return std::make_shared<GeographicProjection>(p);
+		}
+
+		if (!root.is("PROJCS") && !root.is("PROJCRS"))
+			return nullptr;
+
+		const WktNode* geogcs = root.child("GEOGCS");
+		if (geogcs)
+			wktGeographicParams(*geogcs, p);
+
+		const WktNode* unit = root.child("UNIT");
+		if (unit)
+			p.fMetersPerUnit = unit->number(1, 1.0);
+		if (p.fMetersPerUnit <= 0)
+			p.fMetersPerUnit = 1.0;
+
+		wktParameter(root, "False_Easting", p.fFalseEasting);
+		wktParameter(root, "False_Northing", p.fFalseNorthing);
+		if (!wktParameter(root, "Central_Meridian", p.fCentralMeridian))
+			wktParameter(root, "Longitude_Of_Center", p.fCentralMeridian);
+		if (!wktParameter(root, "Latitude_Of_Origin", p.fLatitudeOfOrigin))
+			wktParameter(root, "Latitude_Of_Center", p.fLatitudeOfOrigin);
+		wktParameter(root, "Scale_Factor", p.fScaleFactor);
+		wktParameter(root, "Standard_Parallel_1", p.fStandardParallel1);
+		p.fHasStandardParallel2 = wktParameter(root, "Standard_Parallel_2", p.fStandardParallel2);
+
+		// The WKT angles are in the geographic unit, which is nearly always degrees
+		p.fCentralMeridian *= p.fDegreesPerUnit;
+		p.fLatitudeOfOrigin *= p.fDegreesPerUnit;
+		p.fStandardParallel1 *= p.fDegreesPerUnit;
+		p.fStandardParallel2 *= p.fDegreesPerUnit;
+
+		const WktNode* projection = root.child("PROJECTION");
+		const std::string& method = projection ? projection->name() : root.name();
+
+		if (wktEqualNoCase(method, "Transverse_Mercator") || wktEqualNoCase(method, "Gauss_Kruger"))
+			return std::make_shared<TransverseMercatorProjection>(p);
+
+		if (wktEqualNoCase(method, "Albers") || wktEqualNoCase(method, "Albers_Conic_Equal_Area"))
+			return std::make_shared<AlbersEqualAreaProjection>(p);
+
+		if (wktEqualNoCase(method, "Lambert_Conformal_Conic") || wktEqualNoCase(method, "Lambert_Conformal_Conic_2SP"))
+		{
+			if (!p.fHasStandardParallel2 && wktEqualNoCase(method, "Lambert_Conformal_Conic"))
+			{
+				// ESRI writes the single parallel form with the same name
+				p.fLatitudeOfOrigin = p.fStandardParallel1;
+			}
+			return std::make_shared<LambertConformalConicProjection>(p);
+		}
+
+		if (wktEqualNoCase(method, "Lambert_Conformal_Conic_1SP"))
+		{
+			p.fHasStandardParallel2 = false;
+			return std::make_shared<LambertConformalConicProjection>(p);
+		}
+
+		if (wktEqualNoCase(method, "Mercator_Auxiliary_Sphere") || wktEqualNoCase(method, "Popular_Visualisation_Pseudo_Mercator") ||
+			wktEqualNoCase(root.name(), "WGS 84 / Pseudo-Mercator") || wktEqualNoCase(root.name(), "WGS_1984_Web_Mercator_Auxiliary_Sphere"))
+		{
+			return std::make_shared<WebMercatorProjection>(p);
+		}
+
+		return nullptr;
+	}
+
+	// The extent of a rectangle once it's been through transform(x, y, n),
+	// which replaces the coordinates in x[] and y[].  A projection bends
+	// the edges of a rectangle, so the corners alone can miss some of it,
+	// the middle of an edge can bulge out past them.  Each edge is sampled
+	// kProjEdgeSamples times, starting at a corner.
+	static constexpr int kProjEdgeSamples = 64;
+
+	template <typename Transform>
+	static void projEdgeExtent(double minX, double minY, double maxX, double maxY, Transform&& transform,
+		double& outMinX, double& outMinY, double& outMaxX, double& outMaxY)
+	{
+		double xs[kProjEdgeSamples * 4];
+		double ys[kProjEdgeSamples * 4];
+		double w = maxX - minX;
+		double h = maxY - minY;
+		for (int i = 0; i < kProjEdgeSamples; i++)
+		{
+			double t = (double)i / kProjEdgeSamples;
+			double* ex = &xs[i * 4];
+			double* ey = &ys[i * 4];
+			ex[0] = minX + (w * t);		ey[0] = minY;
+			ex[1] = maxX;				ey[1] = minY + (h * t);
+			ex[2] = maxX - (w * t);		ey[2] = maxY;
+			ex[3] = minX;				ey[3] = maxY - (h * t);
+		}
+		transform(xs, ys, (size_t)kProjEdgeSamples * 4);
+
+		outMinX = outMaxX = xs[0];
+		outMinY = outMaxY = ys[0];
+		for (int i = 1; i < kProjEdgeSamples * 4; i++)
+		{
+			outMinX = xs[i] < outMinX ? xs[i] : outMinX;
+			outMaxX = xs[i] > outMaxX ? xs[i] : outMaxX;
+			outMinY = ys[i] < outMinY ? ys[i] : outMinY;
+			outMaxY = ys[i] > outMaxY ? ys[i] : outMaxY;
+		}
+	}
+
+	//
+	// ProjectionGrid
+	//
+	// One direction of a projection, forward or inverse, sampled on a grid
+	// over a rectangle, and bilinearly interpolated within the cells.
+	// Inside the rectangle a point costs a couple of multiplies to find
+	// its cell, and a bilinear blend, whatever the projection.  Points
+	// outside it go through the exact projection.
+	//
+	// The rectangle is cut into a coarse grid of cells, and each cell is
+	// subdivided on its own, by powers of two, until interpolating is 
+	// within the error, so the grid is only fine where the projection 
+	// bends the most.  The error is checked at the midpoints of the subcells edges
+	// and centers, where bilinear interpolation is furthest off.
+	//
+	// A cell is never cut more than kMaxDivisions to a side.  If that's
+	// not enough, the cell is kept anyway, and meetsError() is false.
+	// fitError() is what was actually reached, either way.
+	//
+	// The error is a distance in the projected coordinate system's
+	// linear unit.  For the inverse, the lon/lat difference is turned into
+	// a distance on the ellipsoid's semi-major axis.
+	//
+	// Neighbouring cells can be subdivided differently, so there can be
+	// a step between them along a shared edge, no bigger than the error
+	// allowed on either side.
+	//
+	struct ProjectionGrid
+	{
+		static constexpr uint32_t kCoarseCells = 16;		// along the longer side
+		static constexpr uint32_t kMaxDivisions = 256;		// per coarse cell, along each side
+
+		struct Cell
+		{
+			uint32_t fDivisions{ 0 };
+			uint32_t fFirstNode{ 0 };
+		};
+
+		const Projection* fProjection{ nullptr };
+		bool fInverse{ false };
+		double fMaxError{ 0 };			// what was asked for
+		double fFitError{ 0 };			// what was measured, at the sample points
+		double fErrorPerDegree{ 1 };	// inverse only, distance of a degree of latitude
+
+		double fMinX{ 0 };
+		double fMinY{ 0 };
+		double fMaxX{ 0 };
+		double fMaxY{ 0 };
+		double fCellW{ 1 };
+		double fCellH{ 1 };
+		double fInvCellW{ 1 };
+		double fInvCellH{ 1 };
+		uint32_t fCols{ 0 };
+		uint32_t fRows{ 0 };
+
+		std::vector<Cell> fCells{};
+		std::vector<double> fNodeU{};	// interpolated outputs, per node
+		std::vector<double> fNodeV{};
+
+		ProjectionGrid() = default;
+
+		// The projection must outlive the grid
+		ProjectionGrid(const Projection& proj, bool inverse, double minX, double minY, double maxX, double maxY, double maxError)
+		{
+			build(proj, inverse, minX, minY, maxX, maxY, maxError);
+		}
+
+		double maxError() const { return fMaxError; }
+		double fitError() const { return fFitError; }
+		bool meetsError() const { return fFitError <= fMaxError; }
+		size_t numNodes() const { return fNodeU.size(); }
+
+		bool contains(double x, double y) const
+		{
+			return x >= fMinX && x <= fMaxX && y >= fMinY && y <= fMaxY;
+		}
+
+		void exact(const double* x, const double* y, double* u, double* v, size_t n) const
+		{
+			if (fInverse)
+				fProjection->inverse(x, y, u, v, n);
+			else
+				fProjection->forward(x, y, u, v, n);
+		}
+
+		// How far apart two outputs are, in the linear unit
+		INLINE double distance(double u0, double v0, double u1, double v1) const
+		{
+			double du = u1 - u0;
+			double dv = v1 - v0;
+			if (fInverse)
+			{
+				du *= std::cos(v0 * waavs::DegToRad);
+				return std::sqrt((du * du) + (dv * dv)) * fErrorPerDegree;
+			}
+
+			return std::sqrt((du * du) + (dv * dv));
+		}
+
+		void build(const Projection& proj, bool inverse, double minX, double minY, double maxX, double maxY, double maxError)
+		{
+			fProjection = &proj;
+			fInverse = inverse;
+			fMaxError = maxError;
+			fFitError = 0;
+			fErrorPerDegree = (proj.params().fEllipsoid.a * waavs::DegToRad) / proj.params().fMetersPerUnit;
+
+			fMinX = minX;
+			fMinY = minY;
+			fMaxX = maxX;
+			fMaxY = maxY;
+
+			double w = maxX - minX;
+			double h = maxY - minY;
+			double longest = w > h ? w : h;
+			if (!(longest > 0))
+				longest = 1;
+
+			fCols = (uint32_t)std::ceil(kCoarseCells * (w / longest));
+			fRows = (uint32_t)std::ceil(kCoarseCells * (h / longest));
+			fCols = fCols < 1 ? 1 : fCols;
+			fRows = fRows < 1 ? 1 : fRows;
+			fCellW = w > 0 ? w / fCols : 1;
+			fCellH = h > 0 ? h / fRows : 1;
+			fInvCellW = 1.0 / fCellW;
+			fInvCellH = 1.0 / fCellH;
+
+			fCells.assign((size_t)fCols * fRows, Cell());
+			fNodeU.clear();
+			fNodeV.clear();
+
+			// leave some room for error between the sample points
+			double target = maxError * 0.5;
+
+			std::vector<double> xs, ys, us, vs, prevU, prevV;
+			std::vector<size_t> pending;
+			for (uint32_t row = 0; row < fRows; row++)
+			{
+				for (uint32_t col = 0; col < fCols; col++)
+				{
+					double x0 = fMinX + (col * fCellW);
+					double y0 = fMinY + (row * fCellH);
+					uint32_t prevSide = 0;
+
+					for (uint32_t div = 1; ; )
+					{
+						// Sample at twice the resolution, the even points
+						// are the nodes, the rest are where to check the error
+						uint32_t side = (div * 2) + 1;
+						size_t count = (size_t)side * side;
+						us.resize(count);
+						vs.resize(count);
+
+						// The divisions only go up by powers of two, so every
+						// sample from the last pass is on this grid too, and
+						// only the new ones need the exact projection
+						uint32_t ratio = prevSide > 0 ? (side - 1) / (prevSide - 1) : 0;
+						xs.clear();
+						ys.clear();
+						pending.clear();
+						for (uint32_t j = 0; j < side; j++)
+						{
+							for (uint32_t i = 0; i < side; i++)
+							{
+								size_t at = ((size_t)j * side) + i;
+								if (ratio > 0 && (i % ratio) == 0 && (j % ratio) == 0)
+								{
+									size_t from = ((size_t)(j / ratio) * prevSide) + (i / ratio);
+									us[at] = prevU[from];
+									vs[at] = prevV[from];
+									continue;
+								}
+
+								xs.push_back(x0 + (fCellW * i) / (div * 2));
+								ys.push_back(y0 + (fCellH * j) / (div * 2));
+								pending.push_back(at);
+							}
+						}
+						exact(xs.data(), ys.data(), xs.data(), ys.data(), xs.size());
+						for (size_t k = 0; k < pending.size(); k++)
+						{
+							us[pending[k]] = xs[k];
+							vs[pending[k]] = ys[k];
+						}
+
+						double err = 0;
+						for (uint32_t j = 0; j < side; j++)
+						{
+							for (uint32_t i = 0; i < side; i++)
+							{
+								if ((i % 2) == 0 && (j % 2) == 0)
+									continue;
+
+								// the nodes on either side, or at the corners
+								uint32_t i0 = i & ~1u;
+								uint32_t j0 = j & ~1u;
+								uint32_t i1 = (i % 2) ? i0 + 2 : i0;
+								uint32_t j1 = (j % 2) ? j0 + 2 : j0;
+								size_t a = (j0 * side) + i0;
+								size_t b = (j0 * side) + i1;
+								size_t c = (j1 * side) + i0;
+								size_t d = (j1 * side) + i1;
+								double u = (us[a] + us[b] + us[c] + us[d]) * 0.25;
+								double v = (vs[a] + vs[b] + vs[c] + vs[d]) * 0.25;
+
+								double e = distance(us[(j * side) + i], vs[(j * side) + i], u, v);
+								err = e > err ? e : err;
+							}
+						}
+
+						if (err <= target || div >= kMaxDivisions)
+						{
+							Cell& cell = fCells[((size_t)row * fCols) + col];
+							cell.fDivisions = div;
+							cell.fFirstNode = (uint32_t)fNodeU.size();
+							for (uint32_t j = 0; j < side; j += 2)
+							{
+								for (uint32_t i = 0; i < side; i += 2)
+								{
+									fNodeU.push_back(us[(j * side) + i]);
+									fNodeV.push_back(vs[(j * side) + i]);
+								}
+							}
+							fFitError = err > fFitError ? err : fFitError;
+							break;
+						}
+
+						// The error goes with the square of the spacing, so
+						// go straight to the subdivision that should be enough
+						double wanted = div * std::sqrt(err / target);
+						uint32_t next = div * 2;
+						while (next < wanted && next < kMaxDivisions)
+							next *= 2;
+						div = next < kMaxDivisions ? next : kMaxDivisions;
+
+						prevU.swap(us);
+						prevV.swap(vs);
+						prevSide = side;
+					}
+				}
+			}
+		}
+
+		// Same as the exact projection, to within maxError()
+		void apply(const double* x, const double* y, double* u, double* v, size_t n) const
+		{
+			for (size_t k = 0; k < n; k++)
+			{
+				double px = x[k];
+				double py = y[k];
+
+				// also catches NaN
+				if (!contains(px, py))
+				{
+					exact(&x[k], &y[k], &u[k], &v[k], 1);
+					continue;
+				}
+
+				double fx = (px - fMinX) * fInvCellW;
+				double fy = (py - fMinY) * fInvCellH;
+				uint32_t col = (uint32_t)fx;
+				uint32_t row = (uint32_t)fy;
+				col = col < fCols ? col : fCols - 1;
+				row = row < fRows ? row : fRows - 1;
+
+				const Cell& cell = fCells[((size_t)row * fCols) + col];
+				uint32_t div = cell.fDivisions;
+
+				double sx = (fx - col) * div;
+				double sy = (fy - row) * div;
+				uint32_t i = (uint32_t)sx;
+				uint32_t j = (uint32_t)sy;
+				i = i < div ? i : div - 1;
+				j = j < div ? j : div - 1;
+				double tx = sx - i;
+				double ty = sy - j;
+
+				size_t stride = (size_t)div + 1;
+				size_t a = cell.fFirstNode + (j * stride) + i;
+				size_t c = a + stride;
+
+				double u0 = fNodeU[a] + ((fNodeU[a + 1] - fNodeU[a]) * tx);
+				double u1 = fNodeU[c] + ((fNodeU[c + 1] - fNodeU[c]) * tx);
+				double v0 = fNodeV[a] + ((fNodeV[a + 1] - fNodeV[a]) * tx);
+				double v1 = fNodeV[c] + ((fNodeV[c + 1] - fNodeV[c]) * tx);
+				u[k] = u0 + ((u1 - u0) * ty);
+				v[k] = v0 + ((v1 - v0) * ty);
+			}
+		}
+
+		// The largest difference from the exact projection, over a 
+		// samples x samples sweep of the rectangle
+		double measureError(size_t samples = 1024) const
+		{
+			std::vector<double> xs(samples), ys(samples), ua(samples), va(samples), ue(samples), ve(samples);
+			double err = 0;
+			for (size_t j = 0; j < samples; j++)
+			{
+				for (size_t i = 0; i < samples; i++)
+				{
+					xs[i] = fMinX + ((fMaxX - fMinX) * i) / (samples - 1);
+					ys[i] = fMinY + ((fMaxY - fMinY) * j) / (samples - 1);
+				}
+				apply(xs.data(), ys.data(), ua.data(), va.data(), samples);
+				exact(xs.data(), ys.data(), ue.data(), ve.data(), samples);
+				for (size_t i = 0; i < samples; i++)
+				{
+					double e = distance(ue[i], ve[i], ua[i], va[i]);
+					err = e > err ? e : err;
+				}
+			}
+			return err;
+		}
+	};
+
+	//
+	// GridProjection
+	//
+	// A projection that answers from ProjectionGrids, for the area a
+	// layer covers, and from the projection it wraps everywhere else.
+	// The rectangle is in the projected coordinates, such as the bounding
+	// box in a .shp header.  The forward grid covers the lon/lat extent
+	// of that rectangle.
+	//
+	// The inverse grid is built up front.  The forward grid is only built
+	// the first time it's needed, as reading a layer only ever unprojects.
+	// Building a grid costs the exact projection of every sample, so over
+	// a large layer, with a fine tolerance, it's not free.  A statewide
+	// LCC layer at a centimeter takes about a second, at a millimeter,
+	// over ten.
+	//
+	// Usage:
+	//	// good to a centimeter, over the layer
+	//	auto fast = GridProjection::create_shared(proj, hdr.xMin, hdr.yMin, hdr.xMax, hdr.yMax, 0.01);
+	//	fast->inverse(xs, ys, lons, lats, n);
+	//
+	struct GridProjection : public Projection
+	{
+		std::shared_ptr<Projection> fExact{};
+		ProjectionGrid fInverseGrid{};
+
+		// Built by forwardGrid(), the first time it's called
+		mutable std::once_flag fForwardOnce{};
+		mutable ProjectionGrid fForwardGrid{};
+
+		double fMinX{ 0 };
+		double fMinY{ 0 };
+		double fMaxX{ 0 };
+		double fMaxY{ 0 };
+		double fMaxError{ 0 };
+
+		GridProjection(std::shared_ptr<Projection> exact, double minX, double minY, double maxX, double maxY, double maxError)
+			: Projection(exact->params())
+			, fExact(exact)
+			, fMinX(minX)
+			, fMinY(minY)
+			, fMaxX(maxX)
+			, fMaxY(maxY)
+			, fMaxError(maxError)
+		{
+			fInverseGrid.build(*fExact, true, minX, minY, maxX, maxY, maxError);
+		}
+
+		static std::shared_ptr<GridProjection> create_shared(std::shared_ptr<Projection> exact, double minX, double minY, double maxX, double maxY, double maxError)
+		{
+			if (!exact)
+				return nullptr;
+
+			return std::make_shared<GridProjection>(exact, minX, minY, maxX, maxY, maxError);
+		}
+
+		const Projection& exact() const { return *fExact; }
+		const ProjectionGrid& inverseGrid() const { return fInverseGrid; }
+
+		// Whether the inverse grid is within the error everywhere
+		// If it isn't, the exact projection is the better choice
+		bool meetsError() const { return fInverseGrid.meetsError(); }
+
+		const ProjectionGrid& forwardGrid() const
+		{
+			std::call_once(fForwardOnce, [this]() {
+				// The lon/lat extent, from around the edge of the rectangle
+				double lonMin, latMin, lonMax, latMax;
+				projEdgeExtent(fMinX, fMinY, fMaxX, fMaxY, [this](double* xs, double* ys, size_t n) {
+					fExact->inverse(xs, ys, xs, ys, n);
+				}, lonMin, latMin, lonMax, latMax);
+
+				fForwardGrid.build(*fExact, false, lonMin, latMin, lonMax, latMax, fMaxError);
+			});
+
+			return fForwardGrid;
+		}
+
+		bool isGeographic() const override { return fExact->isGeographic(); }
+
+		void forward(const double* lon, const double* lat, double* x, double* y, size_t n) const override
+		{
+			forwardGrid().apply(lon, lat, x, y, n);
+		}
+
+		void inverse(const double* x, const double* y, double* lon, double* lat, size_t n) const override
+		{
+			fInverseGrid.apply(x, y, lon, lat, n);
+		}
+	};
+}
@@ -5,6 +5,8 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <compare>
+#include <iterator>
 
 #include "bspan.h"
 #include "shptypes.h"
@@ -133,14 +135,13 @@ namespace waavs {
 		size_t fRecordNumber{ 0 };
 
 		ShapefileRecord() = default;
-		ShapefileRecord(const ShapefileRecord& other) :fRecordNumber(other.fRecordNumber) {}
+		ShapefileRecord(const ShapefileRecord& other) = default;
+		ShapefileRecord(ShapefileRecord&& other) = default;
+		virtual ~ShapefileRecord() = default;
 		
-		ShapefileRecord& operator=(const ShapefileRecord& other)
-		{
-			fRecordNumber = other.fRecordNumber;
+		ShapefileRecord& operator=(const ShapefileRecord& other) = default;
+		ShapefileRecord& operator=(ShapefileRecord&& other) = default;
 
-			return *this;
-		}
 		constexpr size_t recordNumber() const { return fRecordNumber; }
 		constexpr void recordNumber(size_t num) { fRecordNumber = num; }
 		
@@ -162,20 +163,17 @@ namespace waavs {
 		ShpShapeType fShapeType{ ShpShapeType::NullShape };
 		
 		ShpRecord() = default;
-		ShpRecord(const ShpRecord& other) 
-			:ShapefileRecord(other)
-			, fContentSpan(other.fContentSpan)
-			, fShapeType(other.fShapeType)
-		{}
-		
-		ShpRecord& operator=(const ShpRecord& other)
+		ShpRecord(const ShpRecord& other) = default;
+		ShpRecord(ShpRecord&& other) = default;
+		ShpRecord(size_t recordNum, const waavs::ByteSpan& content, ShpShapeType kind)
+			: fContentSpan(content)
+			, fShapeType(kind)
 		{
-			ShapefileRecord::operator=(other);
-			fContentSpan = other.fContentSpan;
-			fShapeType = other.fShapeType;
-			
-			return *this;
+			fRecordNumber = recordNum;
 		}
+		
+		ShpRecord& operator=(const ShpRecord& other) = default;
+		ShpRecord& operator=(ShpRecord&& other) = default;
 
 		// return the shapetype
 		ShpShapeType shapeType() const { return fShapeType; }
@@ -222,52 +220,195 @@ namespace waavs {
 		}
 	};
 
-	
+
+	//
+	// ShpRecordTable
+	// 
+	// A compact table of the records in a .shp file.  Rather than keeping
+	// a ShpRecord object (vtable, record number, two pointer span, shape type)
+	// per record, the table keeps three flat columns
+	//   offset - 32-bit byte offset of the record content from the beginning of the file
+	//   length - 32-bit length of the record content, in bytes
+	//   type   - 8-bit shape type
+	// That's 9 bytes per record instead of 40.  A .shp file can not be
+	// larger than 2^31 16-bit words, so the byte offsets always fit.
+	//
+	// Record numbers are not stored.  The spec says they begin at 1, 
+	// and are sequential, so the record number is index + 1.
+	//
+	// Iterating the table hands out ShpRecord values, so it can be 
+	// used in the same places a std::vector<ShpRecord> was.
+	//
+	struct ShpRecordTable
+	{
+		const uint8_t* fBase{ nullptr };		// beginning of the .shp file
+		std::vector<uint32_t> fOffsets{};
+		std::vector<uint32_t> fLengths{};
+		std::vector<uint8_t> fTypes{};
+
+		struct iterator
+		{
+			using iterator_concept = std::random_access_iterator_tag;
+			using iterator_category = std::input_iterator_tag;
+			using value_type = ShpRecord;
+			using difference_type = std::ptrdiff_t;
+			using reference = ShpRecord;
+
+			const ShpRecordTable* fTable{ nullptr };
+			size_t fIndex{ 0 };
+
+			iterator() = default;
+			iterator(const ShpRecordTable* table, size_t idx) : fTable(table), fIndex(idx) {}
+
+			ShpRecord operator*() const { return fTable->at(fIndex); }
+			ShpRecord operator[](difference_type n) const { return fTable->at(fIndex + n); }
+
+			iterator& operator++() { ++fIndex; return *this; }
+			iterator operator++(int) { iterator tmp = *this; ++fIndex; return tmp; }
+			iterator& operator--() { --fIndex; return *this; }
+			iterator operator--(int) { iterator tmp = *this; --fIndex; return tmp; }
+			iterator& operator+=(difference_type n) { fIndex += n; return *this; }
+			iterator& operator-=(difference_type n) { fIndex -= n; return *this; }
+			iterator operator+(difference_type n) const { return { fTable, fIndex + n }; }
+			iterator operator-(difference_type n) const { return { fTable, fIndex - n }; }
+			friend iterator operator+(difference_type n, const iterator& it) { return it + n; }
+			difference_type operator-(const iterator& other) const { return (difference_type)fIndex - (difference_type)other.fIndex; }
+
+			bool operator==(const iterator& other) const { return fIndex == other.fIndex; }
+			auto operator<=>(const iterator& other) const { return fIndex <=> other.fIndex; }
+		};
+
+		const uint8_t* base() const { return fBase; }
+		void base(const uint8_t* b) { fBase = b; }
+
+		size_t size() const { return fOffsets.size(); }
+		bool empty() const { return fOffsets.empty(); }
+
+		void clear()
+		{
+			fOffsets.clear();
+			fLengths.clear();
+			fTypes.clear();
+		}
+
+		void reserve(size_t n)
+		{
+			fOffsets.reserve(n);
+			fLengths.reserve(n);
+			fTypes.reserve(n);
+		}
+
+		// Make room for exactly n records, so they can be 
+		// filled in, by index, with setRecord()
+		void resize(size_t n)
+		{
+			fOffsets.resize(n);
+			fLengths.resize(n);
+			fTypes.resize(n);
+		}
+
+		void addRecord(uint32_t contentOffset, uint32_t contentLength, ShpShapeType kind)
+		{
+			fOffsets.push_back(contentOffset);
+			fLengths.push_back(contentLength);
+			fTypes.push_back(shpPackShapeType((int32_t)kind));
+		}
+
+		void setRecord(size_t idx, uint32_t contentOffset, uint32_t contentLength, ShpShapeType kind)
+		{
+			fOffsets[idx] = contentOffset;
+			fLengths[idx] = contentLength;
+			fTypes[idx] = shpPackShapeType((int32_t)kind);
+		}
+
+		// Access to individual columns
+		// A type that wasn't valid in the file comes back as kShpInvalidType
+		size_t recordNumber(size_t idx) const { return idx + 1; }
+		ShpShapeType shapeType(size_t idx) const { return (ShpShapeType)fTypes[idx]; }
+		size_t contentOffset(size_t idx) const { return fOffsets[idx]; }
+		size_t contentSize(size_t idx) const { return fLengths[idx]; }
+		waavs::ByteSpan content(size_t idx) const { return waavs::ByteSpan(fBase + fOffsets[idx], fLengths[idx]); }
+
+		const std::vector<uint32_t>& offsets() const { return fOffsets; }
+		const std::vector<uint32_t>& lengths() const { return fLengths; }
+		const std::vector<uint8_t>& types() const { return fTypes; }
+
+		ShpRecord at(size_t idx) const { return ShpRecord(recordNumber(idx), content(idx), shapeType(idx)); }
+		ShpRecord operator[](size_t idx) const { return at(idx); }
+
+		iterator begin() const { return { this, 0 }; }
+		iterator end() const { return { this, size() }; }
+
+		// Number of bytes used by the table columns
+		size_t memoryUsage() const
+		{
+			return fOffsets.capacity() * sizeof(uint32_t) + fLengths.capacity() * sizeof(uint32_t) + fTypes.capacity();
+		}
+	};
+
 	//
 	// ShpContentFile
 	// Represents the '.shp' file, and contains the actual content
 	//
 	struct ShpFile : public ShapefileHeader
 	{
-		std::vector<ShpRecord> fRecords{};
+		ShpRecordTable fRecords{};
 
 		
 		ShpFile(const std::string& name) :ShapefileHeader(name) {}
-		ShpFile(const ShpFile& other) :ShapefileHeader(other), fRecords(other.fRecords) {}
+		ShpFile(const ShpFile& other) = default;
+		ShpFile(ShpFile&& other) = default;
 		
-		ShpFile& operator=(const ShpFile& other)
-		{
-			ShapefileHeader::operator=(other);
-			fRecords = other.fRecords;
-
-			return *this;
-		}
+		ShpFile& operator=(const ShpFile& other) = default;
+		ShpFile& operator=(ShpFile&& other) = default;
 
 		
-		const std::vector<ShpRecord>& records() const
+		const ShpRecordTable& records() const
 		{
 			return fRecords;
 		}
 		
+		// Capture the beginning of the file, as record offsets
+		// are relative to that, just like they are in the .shx
+		bool readFromStream(waavs::ByteSpan& bs) override
+		{
+			fRecords.clear();
+			fRecords.base(bs.data());
+
+			return ShapefileHeader::readFromStream(bs);
+		}
+
 		// read records
 		// We don't parse the record content here, just read the record header
 		// including the size and shape type
 		bool readSelfFromStream(waavs::ByteSpan& bs) override
 		{
+			const uint8_t* base = fRecords.base();
+
 			// read records
-			auto sentinel = bs.data();
 			while (bs.size() > 0) {
-				ShpRecord rec;
-				if (!rec.readFromStream(bs))
+				if (bs.size() < 8)
 					return false;
-				fRecords.push_back(rec);
 
 				// Skip to the next record, based on the size the record
-				// we just read said it was.  We did not read the full record
+				// header says it is.  We do not read the full record
 				// content, only enough to know to capture the record
 				// for later processing
-				bs.fStart = (sentinel + rec.recordSize());
-				sentinel = bs.data();
+				size_t cSize = (size_t)as_u32_be(bs.data() + 4) * 2;
+				if (bs.size() - 8 < cSize)
+					return false;
+
+				size_t cOffset = (bs.data() + 8) - base;
+				if (cOffset > UINT32_MAX)
+					return false;
+
+				ShpShapeType kind = ShpShapeType::NullShape;
+				if (cSize >= 4)
+					kind = (ShpShapeType)as_u32_le(bs.data() + 8);
+
+				fRecords.addRecord((uint32_t)cOffset, (uint32_t)cSize, kind);
+
+				bs.skip(8 + cSize);
 			}
 
 			//printf("Record Count: %d\n", fRecords.size());
@@ -307,6 +448,13 @@ namespace waavs {
 			recordNumber(recordNum); 
 		}
 
+		ShxRecord(int32_t recordNum, size_t recordOffset, size_t contentSize)
+			: fRecordOffset(recordOffset)
+			, fContentSize(contentSize)
+		{
+			recordNumber(recordNum);
+		}
+
 		ShxRecord& operator=(const ShxRecord& other)
 		{
 			ShapefileRecord::operator=(other);
@@ -362,7 +510,8 @@ namespace waavs {
 		std::map<int32_t, ShxRecord> fRecordMap;
 		int32_t fRecordCount{ 0 };
 		
-		ShxFile() = default;
+		ShxFile() :ShapefileHeader("") {}
+		ShxFile(const std::string& name) :ShapefileHeader(name) {}
 
 		const std::map<int32_t, ShxRecord>& recordMap() const
 		{
@@ -374,9 +523,18 @@ namespace waavs {
 			return fRecordCount;
 		}
 		
-		const ShxRecord& getRecord(int32_t recordNum)
+		// Return the record for the given record number
+		// If there is no such record, an empty record (record number 0)
+		// is returned, and the map is left alone.
+		const ShxRecord& getRecord(int32_t recordNum) const
 		{
-			return fRecordMap[recordNum];
+			static const ShxRecord empty{};
+
+			auto it = fRecordMap.find(recordNum);
+			if (it == fRecordMap.end())
+				return empty;
+
+			return it->second;
 		}
 		
 		bool readSelfFromStream(waavs::ByteSpan &bs) override
@@ -397,4 +555,78 @@ namespace waavs {
 
 	};
 
-}
\ No newline at end of file
+
+	//
+	// ShxIndex
+	// 
+	// A view of the '.shx' file that leaves the bytes where they are
+	// (typically in a MappedFile), rather than decoding them into a map
+	// the way ShxFile does.  Opening the index is just capturing the span
+	// of entries, and each big endian offset/length pair is decoded on
+	// demand, in O(1).
+	// 
+	// The index passed to the accessors is 0 based, the record
+	// number is that plus 1.
+	//
+	struct ShxIndex : public ShapefileHeader
+	{
+		waavs::ByteSpan fEntries{};
+
+		ShxIndex() :ShapefileHeader("") {}
+		ShxIndex(const std::string& name) :ShapefileHeader(name) {}
+
+		size_t recordCount() const { return fEntries.size() / 8; }
+
+		// These do no bounds checking, the idx must be less than recordCount()
+		size_t recordOffset(size_t idx) const { return (size_t)as_u32_be(fEntries.data() + (idx * 8)) * 2; }
+		size_t contentOffset(size_t idx) const { return recordOffset(idx) + 8; }
+		size_t contentSize(size_t idx) const { return (size_t)as_u32_be(fEntries.data() + (idx * 8) + 4) * 2; }
+
+		// Get a record by record number (1 based), with bounds checking
+		bool getRecord(int32_t recordNum, ShxRecord& rec) const
+		{
+			if (recordNum < 1 || (size_t)recordNum > recordCount())
+				return false;
+
+			size_t idx = (size_t)recordNum - 1;
+			rec = ShxRecord(recordNum, recordOffset(idx), contentSize(idx));
+
+			return true;
+		}
+
+		// Decode every entry at once, for callers that need all the offsets.
+		// The offsets and lengths are converted from 16-bit words to bytes.
+		// offsets - record offsets (including 8 byte record header)
+		// lengths - content lengths
+		// Both must have room for recordCount() values
+		void decodeAll(uint32_t* offsets, uint32_t* lengths) const
+		{
+			static constexpr size_t kBlock = 256;
+			uint32_t pairs[kBlock * 2];
+
+			size_t count = recordCount();
+			const uint8_t* src = fEntries.data();
+
+			for (size_t i = 0; i < count; i += kBlock)
+			{
+				size_t n = (count - i) < kBlock ? (count - i) : kBlock;
+				bswap32_array(src + (i * 8), pairs, n * 2);
+
+				for (size_t j = 0; j < n; j++)
+				{
+					offsets[i + j] = pairs[j * 2] * 2;
+					lengths[i + j] = pairs[(j * 2) + 1] * 2;
+				}
+			}
+		}
+
+		// Just capture where the entries are
+		bool readSelfFromStream(waavs::ByteSpan& bs) override
+		{
+			fEntries = bs;
+			bs.skip(bs.size());
+
+			return (fEntries.size() % 8) == 0;
+		}
+	};
+}
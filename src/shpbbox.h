@@ -0,0 +1,122 @@
+#pragma once
+
+//
+// ShpBBoxColumn
+// 
+// The bounding box of every record, as four contiguous columns of doubles.
+// 
+// The PolyLine, Polygon, MultiPoint, and MultiPatch records (and their Z/M 
+// variants) store their bounding box in the 32 bytes that follow the 
+// shape type, so it can be read without decoding any of the points.
+// Point records get a degenerate box around the point.  Null shapes, 
+// and records too short to hold a box, get NaN in all four columns, so 
+// they fail any overlap test.
+// 
+// Usage:
+//	ShpBBoxColumn boxes;
+//	boxes.extract(shp.records(), 4);
+//	for (size_t i = 0; i < boxes.size(); i++)
+//		if (boxes.xMax[i] >= qxmin && boxes.xMin[i] <= qxmax ...)
+//
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "bspan.h"
+#include "shptypes.h"
+#include "shapefile.h"
+#include "converters.h"
+#include "shpparallel.h"
+
+
+namespace waavs {
+	// Read the bounding box of a single record straight from its content
+	// Returns false, with NaN values, if the record has no box
+	static bool shpRecordBBox(const ByteSpan& content, double& x1, double& y1, double& x2, double& y2) noexcept
+	{
+		const uint8_t* p = content.data();
+		size_t sz = content.size();
+
+		if (sz >= 4)
+		{
+			switch ((ShpShapeType)as_u32_le(p))
+			{
+			case ShpShapeType::Point:
+			case ShpShapeType::PointZ:
+			case ShpShapeType::PointM:
+				if (sz < 20)
+					break;
+				x1 = x2 = as_f64_le(p + 4);
+				y1 = y2 = as_f64_le(p + 12);
+				return true;
+
+			case ShpShapeType::PolyLine:
+			case ShpShapeType::Polygon:
+			case ShpShapeType::MultiPoint:
+			case ShpShapeType::PolyLineZ:
+			case ShpShapeType::PolygonZ:
+			case ShpShapeType::MultiPointZ:
+			case ShpShapeType::PolyLineM:
+			case ShpShapeType::PolygonM:
+			case ShpShapeType::MultiPointM:
+			case ShpShapeType::MultiPatch:
+				if (sz < 36)
+					break;
+				x1 = as_f64_le(p + 4);
+				y1 = as_f64_le(p + 12);
+				x2 = as_f64_le(p + 20);
+				y2 = as_f64_le(p + 28);
+				return true;
+
+			default:
+				break;
+			}
+		}
+
+		x1 = y1 = x2 = y2 = std::numeric_limits<double>::quiet_NaN();
+
+		return false;
+	}
+
+	struct ShpBBoxColumn
+	{
+		std::vector<double> xMin{};
+		std::vector<double> yMin{};
+		std::vector<double> xMax{};
+		std::vector<double> yMax{};
+
+		size_t size() const { return xMin.size(); }
+
+		void resize(size_t n)
+		{
+			xMin.resize(n);
+			yMin.resize(n);
+			xMax.resize(n);
+			yMax.resize(n);
+		}
+
+		// Fill in the columns for records [first, last)
+		void extractRange(const ShpRecordTable& table, size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+				shpRecordBBox(table.content(i), xMin[i], yMin[i], xMax[i], yMax[i]);
+		}
+
+		// Fill in the columns for every record in the table
+		// nThreads == 0 means use all the hardware threads
+		void extract(const ShpRecordTable& table, unsigned nThreads = 1)
+		{
+			size_t count = table.size();
+			resize(count);
+
+			// Each record is only a handful of loads, so threads
+			// only pay off with a lot of records
+			static constexpr size_t kMinRecordsPerThread = 64 * 1024;
+			shpParallelFor(count, nThreads, kMinRecordsPerThread, [this, &table](size_t first, size_t last)
+				{
+					extractRange(table, first, last);
+				});
+		}
+	};
+}
@@ -0,0 +1,467 @@
+#pragma once
+
+//
+// ShpGeometryColumn
+//
+// The geometry of a whole .shp file, decoded into a few large contiguous
+// buffers, in the style of the Arrow geometry layouts.
+//
+//	geomOffsets		size()+1 entries, geometry i owns parts [geomOffsets[i], geomOffsets[i+1])
+//	partOffsets		numParts()+1 entries, part k owns points [partOffsets[k], partOffsets[k+1])
+//	x, y			one entry per point, in separate columns
+//
+// A PolyLine or Polygon has one part per part in the record.  A Point
+// is a single part of one point, a MultiPoint is a single part holding
+// all its points, and a null shape has no parts at all.  The Z and M
+// types are taken as their 2D counterparts, and only x/y are kept.
+// MultiPatch records are left empty, use ShpMultiPatch for those.
+//
+// A .shp file can't be more than 4GB, so 32-bit offsets are always enough.
+//
+// Decoding is done in two passes over the records, which are split
+// into ranges across threads.  The first pass only reads the counts
+// from each record, then the offsets are summed, and the second pass
+// copies the parts and points straight into their final place.
+//
+// Kernels, such as area(), can then run over index ranges, touching
+// memory in order, without decoding anything.
+//
+// How the coordinates are stored is up to a codec
+//	ShpGeometryColumn			double, exact
+//	ShpGeometryColumnF32		float, relative to the header bbox
+//	ShpGeometryColumnFixed32	int32 fixed point across the header bbox
+// 
+// The float and fixed point columns take 8 bytes a vertex, instead of 16.
+// Both are relative to the bounding box in the file header, so decode(shp)
+// should be used, rather than decode(table), unless setBounds() has been
+// called.  See the codecs for the error bounds.
+//
+// Usage:
+//	ShpGeometryColumn geom;
+//	geom.decode(shp, 0);
+//	std::vector<double> a;
+//	geom.areas(a, 0);
+//
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "bspan.h"
+#include "shptypes.h"
+#include "shapefile.h"
+#include "shpparallel.h"
+#include "shpvisit.h"
+
+
+namespace waavs {
+	//
+	// Coordinate codecs
+	// Each codec turns a double into what is stored in the column, and back.
+	// maxErrorX()/maxErrorY() are the most a coordinate inside the bounds
+	// can be off by, once it's been through encode and decode.  That's the
+	// quantization step, plus a few ulps for the double math on either side.
+	//
+
+	static INLINE double shpCoordRoundoff(double origin, double extent) noexcept
+	{
+		return 4 * DBL_EPSILON * (std::fabs(origin) + std::fabs(extent));
+	}
+
+	// Full doubles, no error
+	struct ShpCoordF64
+	{
+		using value_type = double;
+
+		void setBounds(double, double, double, double) {}
+
+		INLINE value_type encodeX(double v) const { return v; }
+		INLINE value_type encodeY(double v) const { return v; }
+		INLINE double decodeX(value_type v) const { return v; }
+		INLINE double decodeY(value_type v) const { return v; }
+
+		double maxErrorX() const { return 0; }
+		double maxErrorY() const { return 0; }
+	};
+
+	// Single precision floats, as offsets from the bottom left of the bounds
+	// A float has a 24-bit significand, so an offset within an extent of 
+	// 'w' is rounded by no more than w / 2^24.  Putting the origin at the
+	// corner of the bounds, rather than (0,0), means all of those bits go 
+	// to the data.  For a layer 1 degree across, that's about 7mm.
+	struct ShpCoordF32
+	{
+		using value_type = float;
+
+		double fOriginX{ 0 };
+		double fOriginY{ 0 };
+		double fExtentX{ 0 };
+		double fExtentY{ 0 };
+
+		void setBounds(double x1, double y1, double x2, double y2)
+		{
+			fOriginX = x1;
+			fOriginY = y1;
+			fExtentX = x2 - x1;
+			fExtentY = y2 - y1;
+		}
+
+		INLINE value_type encodeX(double v) const { return (float)(v - fOriginX); }
+		INLINE value_type encodeY(double v) const { return (float)(v - fOriginY); }
+		INLINE double decodeX(value_type v) const { return fOriginX + (double)v; }
+		INLINE double decodeY(value_type v) const { return fOriginY + (double)v; }
+
+		double maxErrorX() const { return std::ldexp(fExtentX, -24) + shpCoordRoundoff(fOriginX, fExtentX); }
+		double maxErrorY() const { return std::ldexp(fExtentY, -24) + shpCoordRoundoff(fOriginY, fExtentY); }
+	};
+
+	// 32-bit fixed point, with the bounds spread across the whole int32 range
+	// Each step is extent / (2^32 - 1), and values are rounded to the nearest
+	// step, so the error is at most half a step, about extent / 2^33.  For 
+	// a layer 360 degrees across, that's under 5mm.  Values outside the 
+	// bounds (a header that doesn't agree with its records) are clamped to 
+	// the edge, and so aren't covered by the bound.
+	struct ShpCoordFixed32
+	{
+		using value_type = int32_t;
+
+		static constexpr double kSteps = 4294967295.0;		// 2^32 - 1
+		static constexpr double kBias = 2147483648.0;		// 2^31
+
+		double fOriginX{ 0 };
+		double fOriginY{ 0 };
+		double fScaleX{ 1 };
+		double fScaleY{ 1 };
+		double fStepX{ 1 };
+		double fStepY{ 1 };
+
+		void setBounds(double x1, double y1, double x2, double y2)
+		{
+			fOriginX = x1;
+			fOriginY = y1;
+			fStepX = (x2 > x1) ? (x2 - x1) / kSteps : 1;
+			fStepY = (y2 > y1) ? (y2 - y1) / kSteps : 1;
+			fScaleX = 1.0 / fStepX;
+			fScaleY = 1.0 / fStepY;
+		}
+
+		static INLINE value_type quantize(double t)
+		{
+			t = t < 0 ? 0 : (t > kSteps ? kSteps : t);
+			return (value_type)((int64_t)(t + 0.5) - (int64_t)kBias);
+		}
+
+		INLINE value_type encodeX(double v) const { return quantize((v - fOriginX) * fScaleX); }
+		INLINE value_type encodeY(double v) const { return quantize((v - fOriginY) * fScaleY); }
+		INLINE double decodeX(value_type v) const { return fOriginX + (((double)v + kBias) * fStepX); }
+		INLINE double decodeY(value_type v) const { return fOriginY + (((double)v + kBias) * fStepY); }
+
+		double maxErrorX() const { return (fStepX * 0.5) + shpCoordRoundoff(fOriginX, fStepX * kSteps); }
+		double maxErrorY() const { return (fStepY * 0.5) + shpCoordRoundoff(fOriginY, fStepY * kSteps); }
+	};
+
+	template <typename Codec>
+	struct ShpGeometryColumnT
+	{
+		using codec_type = Codec;
+		using value_type = typename Codec::value_type;
+
+		// Below this many records per thread, threads don't pay off
+		static constexpr size_t kMinRecordsPerThread = 16 * 1024;
+
+		Codec fCodec{};
+		std::vector<ShpShapeType> fTypes{};
+		std::vector<uint32_t> fGeomOffsets{};
+		std::vector<uint32_t> fPartOffsets{};
+		std::vector<value_type> x{};
+		std::vector<value_type> y{};
+
+		size_t size() const { return fTypes.size(); }
+		size_t numParts() const { return fPartOffsets.empty() ? 0 : fPartOffsets.size() - 1; }
+		size_t numPoints() const { return x.size(); }
+
+		ShpShapeType shapeType(size_t i) const { return fTypes[i]; }
+
+		const Codec& codec() const { return fCodec; }
+		void setBounds(double x1, double y1, double x2, double y2) { fCodec.setBounds(x1, y1, x2, y2); }
+
+		// A single point, decoded back to a double
+		double px(size_t j) const { return fCodec.decodeX(x[j]); }
+		double py(size_t j) const { return fCodec.decodeY(y[j]); }
+
+		const std::vector<uint32_t>& geomOffsets() const { return fGeomOffsets; }
+		const std::vector<uint32_t>& partOffsets() const { return fPartOffsets; }
+
+		// The parts of geometry i, and the points of part k
+		size_t partBegin(size_t i) const { return fGeomOffsets[i]; }
+		size_t partEnd(size_t i) const { return fGeomOffsets[i + 1]; }
+		size_t pointBegin(size_t k) const { return fPartOffsets[k]; }
+		size_t pointEnd(size_t k) const { return fPartOffsets[k + 1]; }
+
+		void clear()
+		{
+			fTypes.clear();
+			fGeomOffsets.clear();
+			fPartOffsets.clear();
+			x.clear();
+			y.clear();
+		}
+
+		size_t memoryUsage() const
+		{
+			return (fTypes.capacity() * sizeof(ShpShapeType)) +
+				((fGeomOffsets.capacity() + fPartOffsets.capacity()) * sizeof(uint32_t)) +
+				((x.capacity() + y.capacity()) * sizeof(value_type));
+		}
+
+	private:
+		// First pass, how many parts and points a record has
+		struct CountVisitor
+		{
+			ShpShapeType kind{ ShpShapeType::NullShape };
+			size_t parts{ 0 };
+			size_t points{ 0 };
+
+			void operator()(const ShpNullView&) {}
+			void operator()(const ShpPointView& v) { kind = v.shapeType(); parts = 1; points = 1; }
+			void operator()(const ShpMultiPointView& v) { kind = v.shapeType(); parts = 1; points = v.numPoints(); }
+			// with no parts, there's nowhere for points to go, so they're left out
+			void operator()(const ShpMultiPartView& v) { kind = v.shapeType(); parts = v.numParts(); points = parts > 0 ? v.numPoints() : 0; }
+		};
+
+		// Second pass, copy into the slots the first pass made room for
+		struct FillVisitor
+		{
+			ShpGeometryColumnT& col;
+			size_t partPos;
+			size_t pointPos;
+
+			void copyPoints(const ShpPointArray& pts)
+			{
+				const Codec& codec = col.fCodec;
+				value_type* xs = col.x.data() + pointPos;
+				value_type* ys = col.y.data() + pointPos;
+				for (size_t j = 0; j < pts.size(); j++)
+				{
+					xs[j] = codec.encodeX(pts.x(j));
+					ys[j] = codec.encodeY(pts.y(j));
+				}
+			}
+
+			void operator()(const ShpNullView&) {}
+
+			void operator()(const ShpPointView& v)
+			{
+				col.fPartOffsets[partPos] = (uint32_t)pointPos;
+				col.x[pointPos] = col.fCodec.encodeX(v.x);
+				col.y[pointPos] = col.fCodec.encodeY(v.y);
+			}
+
+			void operator()(const ShpMultiPointView& v)
+			{
+				col.fPartOffsets[partPos] = (uint32_t)pointPos;
+				copyPoints(v.points());
+			}
+
+			// The first part starts at the record's first point, even if the
+			// file says otherwise, so points before it stay with this record
+			void operator()(const ShpMultiPartView& v)
+			{
+				col.fPartOffsets[partPos] = (uint32_t)pointPos;
+				for (size_t k = 1; k < v.numParts(); k++)
+					col.fPartOffsets[partPos + k] = (uint32_t)(pointPos + v.partStart(k));
+				copyPoints(v.points());
+			}
+		};
+
+	public:
+		// Decode every record in the file, relative to the bounds in its header
+		bool decode(const ShpFile& shp, unsigned nThreads = 1)
+		{
+			fCodec.setBounds(shp.xMin, shp.yMin, shp.xMax, shp.yMax);
+			return decode(shp.records(), nThreads);
+		}
+
+		// Decode every record in the table
+		// Records that fail to decode are left as empty null shapes, and
+		// make the return value false, though the rest of the column is good.
+		bool decode(const ShpRecordTable& table, unsigned nThreads = 1)
+		{
+			size_t count = table.size();
+			fTypes.assign(count, ShpShapeType::NullShape);
+			fGeomOffsets.assign(count + 1, 0);
+
+			// points per record, until it's turned into offsets
+			std::vector<uint64_t> pointStart(count + 1, 0);
+			std::vector<uint8_t> ok(count, 1);
+
+			shpParallelFor(count, nThreads, kMinRecordsPerThread, [&](size_t first, size_t last)
+				{
+					for (size_t i = first; i < last; i++)
+					{
+						CountVisitor c{};
+						if (!visitShape(table.content(i), c))
+						{
+							ok[i] = 0;
+							continue;
+						}
+						fTypes[i] = c.kind;
+						fGeomOffsets[i + 1] = (uint32_t)c.parts;
+						pointStart[i + 1] = c.points;
+					}
+				});
+
+			uint64_t totalParts = 0;
+			uint64_t totalPoints = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				totalParts += fGeomOffsets[i + 1];
+				totalPoints += pointStart[i + 1];
+				if (totalParts > UINT32_MAX || totalPoints > UINT32_MAX)
+				{
+					clear();
+					return false;
+				}
+				fGeomOffsets[i + 1] = (uint32_t)totalParts;
+				pointStart[i + 1] = totalPoints;
+			}
+
+			fPartOffsets.resize((size_t)totalParts + 1);
+			fPartOffsets[(size_t)totalParts] = (uint32_t)totalPoints;
+			x.resize((size_t)totalPoints);
+			y.resize((size_t)totalPoints);
+
+			shpParallelFor(count, nThreads, kMinRecordsPerThread, [&](size_t first, size_t last)
+				{
+					for (size_t i = first; i < last; i++)
+					{
+						if (!ok[i] || fGeomOffsets[i] == fGeomOffsets[i + 1])
+							continue;
+
+						FillVisitor f{ *this, fGeomOffsets[i], (size_t)pointStart[i] };
+						visitShape(table.content(i), f);
+					}
+				});
+
+			for (size_t i = 0; i < count; i++)
+				if (!ok[i])
+					return false;
+
+			return true;
+		}
+
+		//
+		// Kernels
+		//
+
+		// Area of a polygon, with holes taken away
+		// Outer rings are clockwise, so they come out negative from the
+		// shoelace sum, and holes positive.  Anything but a polygon has no area.
+		double area(size_t i) const
+		{
+			if (shpBaseType(fTypes[i]) != ShpShapeType::Polygon)
+				return 0;
+
+			double sum = 0;
+			for (size_t k = partBegin(i); k < partEnd(i); k++)
+			{
+				size_t first = pointBegin(k);
+				size_t last = pointEnd(k);
+				for (size_t j = first; j + 1 < last; j++)
+					sum += (px(j) * py(j + 1)) - (px(j + 1) * py(j));
+			}
+
+			return -0.5 * sum;
+		}
+
+		// The area weighted centroid of a polygon, or for any other
+		// shape, the average of its points.  Returns false for empty shapes.
+		bool centroid(size_t i, double& cx, double& cy) const
+		{
+			size_t pFirst = partBegin(i);
+			size_t pLast = partEnd(i);
+			if (pFirst == pLast)
+				return false;
+
+			if (shpBaseType(fTypes[i]) == ShpShapeType::Polygon)
+			{
+				double a = 0, sx = 0, sy = 0;
+				for (size_t k = pFirst; k < pLast; k++)
+				{
+					for (size_t j = pointBegin(k); j + 1 < pointEnd(k); j++)
+					{
+						double c = (px(j) * py(j + 1)) - (px(j + 1) * py(j));
+						a += c;
+						sx += (px(j) + px(j + 1)) * c;
+						sy += (py(j) + py(j + 1)) * c;
+					}
+				}
+
+				if (a != 0)
+				{
+					cx = sx / (3 * a);
+					cy = sy / (3 * a);
+					return true;
+				}
+			}
+
+			size_t first = pointBegin(pFirst);
+			size_t last = pointEnd(pLast - 1);
+			if (first == last)
+				return false;
+
+			double sx = 0, sy = 0;
+			for (size_t j = first; j < last; j++)
+			{
+				sx += px(j);
+				sy += py(j);
+			}
+			cx = sx / (double)(last - first);
+			cy = sy / (double)(last - first);
+
+			return true;
+		}
+
+		// Whether the point is inside a polygon, by the even-odd rule
+		// across all of its rings, so holes are handled
+		bool contains(size_t i, double qx, double qy) const
+		{
+			if (shpBaseType(fTypes[i]) != ShpShapeType::Polygon)
+				return false;
+
+			bool inside = false;
+			for (size_t k = partBegin(i); k < partEnd(i); k++)
+			{
+				size_t first = pointBegin(k);
+				size_t last = pointEnd(k);
+				if (last - first < 3)
+					continue;
+
+				for (size_t j = first, p = last - 1; j < last; p = j++)
+				{
+					if (((py(j) > qy) != (py(p) > qy)) &&
+						(qx < px(j) + ((px(p) - px(j)) * (qy - py(j)) / (py(p) - py(j)))))
+						inside = !inside;
+				}
+			}
+
+			return inside;
+		}
+
+		// The area of every geometry
+		void areas(std::vector<double>& out, unsigned nThreads = 1) const
+		{
+			out.resize(size());
+			shpParallelFor(size(), nThreads, kMinRecordsPerThread, [&](size_t first, size_t last)
+				{
+					for (size_t i = first; i < last; i++)
+						out[i] = area(i);
+				});
+		}
+	};
+
+	using ShpGeometryColumn = ShpGeometryColumnT<ShpCoordF64>;
+	using ShpGeometryColumnF32 = ShpGeometryColumnT<ShpCoordF32>;
+	using ShpGeometryColumnFixed32 = ShpGeometryColumnT<ShpCoordFixed32>;
+}
@@ -18,25 +18,40 @@ namespace waavs {
 		ShpShapeType fShapeType{ ShpShapeType::NullShape };
 		std::vector<double> fNumbers{};
 
+		// The Z and M values, one per point, are kept in their own
+		// arrays, alongside the x/y pairs in fNumbers.  They're only
+		// filled in for the shape types that have them, so a 2D shape
+		// never allocates for them.
+		std::vector<double> fZ{};
+		std::vector<double> fM{};
+		double zMin{ 0 };
+		double zMax{ 0 };
+		double mMin{ 0 };
+		double mMax{ 0 };
+		bool fHasZ{ false };
+		bool fHasM{ false };
 
 
 		ShpShape() { ; }
 		ShpShape(ShpShapeType aType) :fShapeType(aType) { ; }
-		ShpShape(const ShpShape& other)
-			:fShapeType(other.fShapeType)
-			, fNumbers(other.fNumbers)
-		{}
+		ShpShape(const ShpShape& other) = default;
+		virtual ~ShpShape() = default;
 
-		ShpShape& operator=(const ShpShape& other)
-		{
-			fShapeType = other.fShapeType;
-			fNumbers = other.fNumbers;
-			return *this;
-		}
+		ShpShape& operator=(const ShpShape& other) = default;
 		
+		ShpShapeType shapeType() const { return fShapeType; }
+
 		// Access to the numbers
 		std::vector<double>& numbers() { return fNumbers; }
 		const std::vector<double>& numbers() const { return fNumbers; }
+
+		// Access to the Z and M values
+		// Check hasZ()/hasM() first, as the M values in particular
+		// are optional, even for shape types that allow them.
+		bool hasZ() const { return fHasZ; }
+		bool hasM() const { return fHasM; }
+		const std::vector<double>& z() const { return fZ; }
+		const std::vector<double>& m() const { return fM; }
 		
 		
 		void addNumber(double aNumber) { fNumbers.push_back(aNumber); }
@@ -73,13 +88,97 @@ namespace waavs {
 			return true;
 		}
 		
+		// Read 'count' points from the stream, all at once
+		// The size is checked once for the whole block, and the
+		// coordinates are copied in bulk, rather than a point at a time
+		bool readPoints(ByteSpan& bs, size_t count)
+		{
+			if (count > bs.size() / 16)
+				return false;
+
+			size_t base = fNumbers.size();
+			fNumbers.resize(base + (count * 2));
+			copy_f64_le(bs.data(), fNumbers.data() + base, count * 2);
+			bs.skip(count * 16);
+
+			return true;
+		}
+		
+		// Read a range block, [min, max], followed by 'count' values 
+		// into the given array
+		static bool readRangeBlock(ByteSpan& bs, size_t count, double& lo, double& hi, std::vector<double>& values)
+		{
+			if (bs.size() < 16 || count > (bs.size() - 16) / 8)
+				return false;
+
+			read_f64_le(bs, lo);
+			read_f64_le(bs, hi);
+
+			values.resize(count);
+			copy_f64_le(bs.data(), values.data(), count);
+			bs.skip(count * 8);
+
+			return true;
+		}
+
+		// Read the Z and M blocks that follow the x/y points of the
+		// multi-point shapes.  The Z block is required for the Z types.
+		// The M block is optional for everything, and is only read if 
+		// there are enough bytes left for it.
+		bool readZMBlocks(ByteSpan& bs, size_t count)
+		{
+			if (shpHasZ(fShapeType))
+			{
+				if (!readRangeBlock(bs, count, zMin, zMax, fZ))
+					return false;
+				fHasZ = true;
+			}
+
+			if (shpHasM(fShapeType) && bs.size() >= 16 + (count * 8))
+			{
+				readRangeBlock(bs, count, mMin, mMax, fM);
+				fHasM = true;
+			}
+
+			return true;
+		}
+
 		virtual bool readSelfFromStream(ByteSpan& bs)
 		{
 			return true;
 		}
 
+		// Clear out the shape, so it can be used to read another record.
+		// The storage is kept, so reading the next record does not have
+		// to allocate again, unless it is bigger than any seen so far.
+		virtual void reset()
+		{
+			fNumbers.clear();
+			fZ.clear();
+			fM.clear();
+			zMin = zMax = mMin = mMax = 0;
+			fHasZ = false;
+			fHasM = false;
+		}
+
+		// Number of bytes of storage being held on to
+		virtual size_t retainedBytes() const
+		{
+			return (fNumbers.capacity() + fZ.capacity() + fM.capacity()) * sizeof(double);
+		}
+
+		// Give back the storage
+		virtual void release()
+		{
+			std::vector<double>().swap(fNumbers);
+			std::vector<double>().swap(fZ);
+			std::vector<double>().swap(fM);
+		}
+
 		virtual bool readFromStream(ByteSpan& bs)
 		{
+			reset();
+
 			// Read the record type first
 			read_i32_le(bs, (int32_t&)fShapeType);
 
@@ -94,12 +193,45 @@ namespace waavs {
 		{}
 
 
+		// A PointZ has a required Z, and optional M, following the x/y
+		// A PointM has an optional M
 		bool readSelfFromStream(ByteSpan& bs) override
 		{
-			return readPoint(bs);
+			if (!readPoint(bs))
+				return false;
+
+			if (shpHasZ(fShapeType))
+			{
+				if (bs.size() < 8)
+					return false;
+				fZ.resize(1);
+				read_f64_le(bs, fZ[0]);
+				zMin = zMax = fZ[0];
+				fHasZ = true;
+			}
+
+			if (shpHasM(fShapeType) && bs.size() >= 8)
+			{
+				fM.resize(1);
+				read_f64_le(bs, fM[0]);
+				mMin = mMax = fM[0];
+				fHasM = true;
+			}
+
+			return true;
 		}
 	};
 
+	struct ShpPointZ : public ShpPoint
+	{
+		ShpPointZ() { fShapeType = ShpShapeType::PointZ; }
+	};
+
+	struct ShpPointM : public ShpPoint
+	{
+		ShpPointM() { fShapeType = ShpShapeType::PointM; }
+	};
+
 	struct ShpMultiPart : public ShpShape
 	{
 		double xMin{ 0 };
@@ -136,6 +268,24 @@ namespace waavs {
 		std::vector<int>& parts() { return fParts; }
 		const std::vector<int>& parts() const { return fParts; }
 		
+		void reset() override
+		{
+			ShpShape::reset();
+			fParts.clear();
+			xMin = yMin = xMax = yMax = 0;
+		}
+
+		size_t retainedBytes() const override
+		{
+			return ShpShape::retainedBytes() + (fParts.capacity() * sizeof(int));
+		}
+
+		void release() override
+		{
+			ShpShape::release();
+			std::vector<int>().swap(fParts);
+		}
+		
 		
 		void addPart(int apart) {fParts.push_back(apart);}
 		
@@ -174,22 +324,22 @@ namespace waavs {
 			read_i32_le(bs, numParts);
 			read_i32_le(bs, numPoints);
 
-			if (bs.size() < numParts * 4)
+			if (numParts < 0 || numPoints < 0)
 				return false;
 
-			for (int i = 0; i < numParts; ++i)
-			{
-				if (!loadPart(bs))
-					break;
-			}
+			// Check once that both arrays are there, then 
+			// copy them in bulk
+			uint64_t needed = ((uint64_t)numParts * 4) + ((uint64_t)numPoints * 16);
+			if (bs.size() < needed)
+				return false;
 
-			for (int i = 0; i < numPoints; ++i)
-			{
-				if (!readPoint(bs))
-					return false;
-			}
+			static_assert(sizeof(int) == sizeof(int32_t), "parts are stored as int");
+			size_t base = fParts.size();
+			fParts.resize(base + numParts);
+			copy_i32_le(bs.data(), (int32_t*)fParts.data() + base, numParts);
+			bs.skip((size_t)numParts * 4);
 
-			return true;
+			return readPoints(bs, (size_t)numPoints);
 		}
 
 		bool readFromStream(ByteSpan& bs) override
@@ -207,6 +357,9 @@ namespace waavs {
 			if (!parsePartsAndPoints(bs))
 				return false;
 
+			if (!readZMBlocks(bs, fNumbers.size() / 2))
+				return false;
+
 			return readSelfFromStream(bs);
 		}
 
@@ -236,10 +389,13 @@ namespace waavs {
 			:ShpMultiPart(ShpShapeType::MultiPoint)
 		{}
 
-		bool readFromStream(ByteSpan& bs)
+		bool readFromStream(ByteSpan& bs) override
 		{
+			// Read the record type first
+			ShpShape::readFromStream(bs);
+
 			// Need at least enough to read the header information
-			if (bs.size() < 44)
+			if (bs.size() < 36)
 				return false;
 
 			parseBBox(bs);
@@ -248,14 +404,137 @@ namespace waavs {
 			int32_t numPoints{ 0 };
 			read_i32_le(bs, numPoints);
 
-			for (int i = 0; i < numPoints; i++)
+			if (numPoints < 0 || !readPoints(bs, (size_t)numPoints))
+				return false;
+
+			if (!readZMBlocks(bs, (size_t)numPoints))
+				return false;
+
+			return readSelfFromStream(bs);
+		}
+	};
+
+	//
+	// The Z and M variants
+	// The decoding is the same as their 2D counterparts, with the 
+	// additional Z/M blocks being read based on the shape type
+	//
+	struct ShpPolyLineZ : public ShpMultiPart
+	{
+		ShpPolyLineZ() :ShpMultiPart(ShpShapeType::PolyLineZ) {}
+	};
+
+	struct ShpPolyLineM : public ShpMultiPart
+	{
+		ShpPolyLineM() :ShpMultiPart(ShpShapeType::PolyLineM) {}
+	};
+
+	struct ShpPolygonZ : public ShpMultiPart
+	{
+		ShpPolygonZ() :ShpMultiPart(ShpShapeType::PolygonZ) {}
+	};
+
+	struct ShpPolygonM : public ShpMultiPart
+	{
+		ShpPolygonM() :ShpMultiPart(ShpShapeType::PolygonM) {}
+	};
+
+	struct ShpMultiPointZ : public ShpMultiPoint
+	{
+		ShpMultiPointZ() { fShapeType = ShpShapeType::MultiPointZ; }
+	};
+
+	struct ShpMultiPointM : public ShpMultiPoint
+	{
+		ShpMultiPointM() { fShapeType = ShpShapeType::MultiPointM; }
+	};
+
+
+	//
+	// ShpDecodeContext
+	// 
+	// Decoding a record into a fresh ShpPolygon (or other shape) means
+	// allocating, then freeing, its parts and coordinate vectors for
+	// every single record.  A decode context instead holds on to one
+	// shape of each kind, and reads each record into the matching one.
+	// Since reset() keeps the vectors' storage, after the first few 
+	// records, decoding does not allocate at all.
+	// 
+	// The shape handed back is only valid until the next record of the
+	// same kind is decoded with the same context.  A context is not 
+	// thread safe, so use one per thread; threadContext() hands out 
+	// one for the calling thread.
+	// 
+	// Call endBatch() between batches of records.  If an unusually large 
+	// record has made the context hold on to more than maxRetainedBytes, 
+	// the storage is given back, otherwise it's kept for the next batch.
+	//
+	struct ShpDecodeContext
+	{
+		static constexpr size_t kDefaultMaxRetainedBytes = 16 * 1024 * 1024;
+
+		ShpPoint fPoint{};
+		ShpPolyLine fPolyLine{};
+		ShpPolygon fPolygon{};
+		ShpMultiPoint fMultiPoint{};
+
+		size_t fMaxRetainedBytes{ kDefaultMaxRetainedBytes };
+
+		ShpDecodeContext() = default;
+		ShpDecodeContext(size_t maxRetained) : fMaxRetainedBytes(maxRetained) {}
+
+		ShpDecodeContext(const ShpDecodeContext& other) = delete;
+		ShpDecodeContext& operator=(const ShpDecodeContext& other) = delete;
+
+		size_t maxRetainedBytes() const { return fMaxRetainedBytes; }
+		void maxRetainedBytes(size_t n) { fMaxRetainedBytes = n; }
+
+		ShpPoint* point(ByteSpan& bs) { return fPoint.readFromStream(bs) ? &fPoint : nullptr; }
+		ShpPolyLine* polyLine(ByteSpan& bs) { return fPolyLine.readFromStream(bs) ? &fPolyLine : nullptr; }
+		ShpPolygon* polygon(ByteSpan& bs) { return fPolygon.readFromStream(bs) ? &fPolygon : nullptr; }
+		ShpMultiPoint* multiPoint(ByteSpan& bs) { return fMultiPoint.readFromStream(bs) ? &fMultiPoint : nullptr; }
+
+		// Decode a record's content into whichever shape matches its type
+		// Returns nullptr if the type is not supported, or the content
+		// is malformed
+		ShpShape* decode(const ByteSpan& content)
+		{
+			if (content.size() < 4)
+				return nullptr;
+
+			ByteSpan bs(content);
+			switch (shpBaseType((ShpShapeType)as_u32_le(content.data())))
 			{
-				readPoint(bs);
-				//load_f64_le(bs);	// x
-				//load_f64_le(bs);	// y
+			case ShpShapeType::Point: return point(bs);
+			case ShpShapeType::PolyLine: return polyLine(bs);
+			case ShpShapeType::Polygon: return polygon(bs);
+			case ShpShapeType::MultiPoint: return multiPoint(bs);
+			default:
+				return nullptr;
 			}
+		}
 
-			return true;
+		size_t retainedBytes() const
+		{
+			return fPoint.retainedBytes() + fPolyLine.retainedBytes() + fPolygon.retainedBytes() + fMultiPoint.retainedBytes();
+		}
+
+		void endBatch()
+		{
+			if (retainedBytes() <= fMaxRetainedBytes)
+				return;
+
+			fPoint.release();
+			fPolyLine.release();
+			fPolygon.release();
+			fMultiPoint.release();
+		}
+
+		// A context for the calling thread
+		static ShpDecodeContext& threadContext()
+		{
+			static thread_local ShpDecodeContext ctx{};
+			return ctx;
 		}
 	};
 }
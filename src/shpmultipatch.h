@@ -0,0 +1,541 @@
+#pragma once
+
+//
+// ShpMultiPatch
+// 
+// Decoding of the MultiPatch (type 31) shape, which is how buildings,
+// and other 3D surfaces, are stored in a shapefile.
+// 
+// A MultiPatch is a set of parts, each of which is one of
+//	TriangleStrip, TriangleFan	- already triangles, they just need indices
+//	OuterRing, InnerRing		- a polygon, with holes
+//	FirstRing, Ring				- a polygon, where it's not known which
+//								  rings are holes; the first ring is taken
+//								  as the outer, and the rest as holes
+// 
+// The record is decoded in one pass into flat buffers that can be handed
+// straight to a renderer
+//	vertices	- x, y, z triples, one per point in the record
+//	m			- one measure per point, if the record has them
+//	indices		- three vertex indices per triangle
+// 
+// Rings are triangulated by ear clipping, in the plane they lie in, with 
+// holes bridged into the outer ring first.  Triangles keep the winding 
+// of the strip, fan, or outer ring they came from.
+//
+// Usage:
+//	ShpMultiPatch mesh;
+//	ByteSpan rs(rec.content());
+//	if (mesh.readFromStream(rs))
+//		upload(mesh.vertices(), mesh.indices());
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "bspan.h"
+#include "shptypes.h"
+#include "converters.h"
+
+
+namespace waavs {
+	enum class ShpPatchType : int32_t
+	{
+		TriangleStrip = 0,
+		TriangleFan = 1,
+		OuterRing = 2,
+		InnerRing = 3,
+		FirstRing = 4,
+		Ring = 5
+	};
+
+	struct ShpMultiPatch
+	{
+		ShpShapeType fShapeType{ ShpShapeType::MultiPatch };
+		double xMin{ 0 };
+		double yMin{ 0 };
+		double xMax{ 0 };
+		double yMax{ 0 };
+		double zMin{ 0 };
+		double zMax{ 0 };
+		double mMin{ 0 };
+		double mMax{ 0 };
+
+		std::vector<int32_t> fParts{};			// index of the first point of each part
+		std::vector<int32_t> fPartTypes{};		// ShpPatchType of each part
+		std::vector<double> fVertices{};		// x,y,z
+		std::vector<double> fM{};
+		std::vector<uint32_t> fIndices{};		// triangle list
+		bool fHasM{ false };
+
+		// scratch space for triangulating rings, kept so it can be reused
+		std::vector<uint32_t> fPolyScratch{};
+		std::vector<uint32_t> fHoleScratch{};
+		std::vector<double> fPlaneScratch{};
+		std::vector<size_t> fHolePartScratch{};		// parts that are holes, in bridging order
+		std::vector<uint32_t> fPendingScratch{};	// edges of holes not yet bridged
+		std::vector<uint32_t> fSpliceScratch{};		// a hole, and the bridge back
+
+		ShpShapeType shapeType() const { return fShapeType; }
+
+		size_t numParts() const { return fParts.size(); }
+		size_t numPoints() const { return fVertices.size() / 3; }
+		size_t numTriangles() const { return fIndices.size() / 3; }
+
+		const std::vector<int32_t>& parts() const { return fParts; }
+		const std::vector<int32_t>& partTypes() const { return fPartTypes; }
+		const std::vector<double>& vertices() const { return fVertices; }
+		const std::vector<uint32_t>& indices() const { return fIndices; }
+
+		bool hasM() const { return fHasM; }
+		const std::vector<double>& m() const { return fM; }
+
+		size_t partStart(size_t i) const { return (size_t)fParts[i]; }
+		size_t partEnd(size_t i) const { return (i + 1 < numParts()) ? (size_t)fParts[i + 1] : numPoints(); }
+		ShpPatchType partType(size_t i) const { return (ShpPatchType)fPartTypes[i]; }
+
+		// Clear everything, keeping the storage for the next record
+		void reset()
+		{
+			fParts.clear();
+			fPartTypes.clear();
+			fVertices.clear();
+			fM.clear();
+			fIndices.clear();
+			fHasM = false;
+			xMin = yMin = xMax = yMax = zMin = zMax = mMin = mMax = 0;
+		}
+
+		bool readFromStream(ByteSpan& bs)
+		{
+			reset();
+
+			if (bs.size() < 44)
+				return false;
+
+			const uint8_t* p = bs.data();
+			fShapeType = (ShpShapeType)as_u32_le(p);
+			if (fShapeType != ShpShapeType::MultiPatch)
+				return false;
+
+			xMin = as_f64_le(p + 4);
+			yMin = as_f64_le(p + 12);
+			xMax = as_f64_le(p + 20);
+			yMax = as_f64_le(p + 28);
+
+			int32_t numParts = (int32_t)as_u32_le(p + 36);
+			int32_t numPoints = (int32_t)as_u32_le(p + 40);
+			if (numParts < 0 || numPoints < 0)
+				return false;
+
+			// parts, part types, points, and the (required) Z block
+			uint64_t n = (uint64_t)numPoints;
+			uint64_t needed = 44 + ((uint64_t)numParts * 8) + (n * 16) + 16 + (n * 8);
+			if (needed > bs.size())
+				return false;
+
+			fParts.resize(numParts);
+			fPartTypes.resize(numParts);
+			copy_i32_le(p + 44, fParts.data(), numParts);
+			copy_i32_le(p + 44 + ((size_t)numParts * 4), fPartTypes.data(), numParts);
+
+			int32_t prev = 0;
+			for (int32_t start : fParts)
+			{
+				if (start < prev || start > numPoints)
+					return false;
+				prev = start;
+			}
+
+			// Interleave the x/y pairs with the z values into the vertex buffer
+			const uint8_t* xy = p + 44 + ((size_t)numParts * 8);
+			const uint8_t* zblock = xy + (n * 16);
+			zMin = as_f64_le(zblock);
+			zMax = as_f64_le(zblock + 8);
+			const uint8_t* zs = zblock + 16;
+
+			fVertices.resize(n * 3);
+			double* v = fVertices.data();
+			for (size_t i = 0; i < n; i++)
+			{
+				v[(i * 3)] = as_f64_le(xy + (i * 16));
+				v[(i * 3) + 1] = as_f64_le(xy + (i * 16) + 8);
+				v[(i * 3) + 2] = as_f64_le(zs + (i * 8));
+			}
+
+			// The M block is optional
+			size_t used = (size_t)needed;
+			if (bs.size() - used >= 16 + (n * 8))
+			{
+				const uint8_t* mblock = p + used;
+				mMin = as_f64_le(mblock);
+				mMax = as_f64_le(mblock + 8);
+				fM.resize(n);
+				copy_f64_le(mblock + 16, fM.data(), n);
+				fHasM = true;
+				used += 16 + (n * 8);
+			}
+
+			buildIndices();
+
+			bs.skip(used);
+
+			return true;
+		}
+
+	private:
+		void addTriangle(uint32_t a, uint32_t b, uint32_t c)
+		{
+			fIndices.push_back(a);
+			fIndices.push_back(b);
+			fIndices.push_back(c);
+		}
+
+		void buildIndices()
+		{
+			size_t np = numParts();
+			fIndices.reserve(numPoints() * 3);
+
+			size_t i = 0;
+			while (i < np)
+			{
+				uint32_t first = (uint32_t)partStart(i);
+				uint32_t last = (uint32_t)partEnd(i);
+
+				switch (partType(i))
+				{
+				case ShpPatchType::TriangleStrip:
+					// every other triangle is flipped, to keep the winding consistent
+					for (uint32_t k = first; k + 2 < last; k++)
+					{
+						if (((k - first) & 1) == 0)
+							addTriangle(k, k + 1, k + 2);
+						else
+							addTriangle(k + 1, k, k + 2);
+					}
+					i++;
+					break;
+
+				case ShpPatchType::TriangleFan:
+					for (uint32_t k = first + 1; k + 1 < last; k++)
+						addTriangle(first, k, k + 1);
+					i++;
+					break;
+
+				case ShpPatchType::OuterRing:
+				case ShpPatchType::FirstRing:
+				case ShpPatchType::InnerRing:
+				case ShpPatchType::Ring:
+				{
+					// A polygon is a leading ring, followed by any holes
+					ShpPatchType holeType = (partType(i) == ShpPatchType::FirstRing) ? ShpPatchType::Ring : ShpPatchType::InnerRing;
+					size_t lastPart = i + 1;
+					while (lastPart < np && partType(lastPart) == holeType)
+						lastPart++;
+
+					triangulatePolygon(i, lastPart);
+					i = lastPart;
+				}
+				break;
+
+				default:
+					// unknown part types are skipped
+					i++;
+					break;
+				}
+			}
+		}
+
+		//
+		// Triangulation of rings
+		// 
+		// The rings are projected onto the axis plane that is closest to
+		// the plane of the outer ring, then holes are joined to the outer
+		// ring with a bridge edge, and the resulting simple polygon is 
+		// clipped one ear at a time.
+		//
+
+		double pu(uint32_t idx) const { return fPlaneScratch[(size_t)idx * 2]; }
+		double pv(uint32_t idx) const { return fPlaneScratch[((size_t)idx * 2) + 1]; }
+
+		static double cross(double ax, double ay, double bx, double by, double cx, double cy)
+		{
+			return ((bx - ax) * (cy - ay)) - ((by - ay) * (cx - ax));
+		}
+
+		// signed area of a ring, in the projected plane
+		double ringArea(uint32_t first, uint32_t last) const
+		{
+			double a = 0;
+			for (uint32_t k = first; k < last; k++)
+			{
+				uint32_t nx = (k + 1 < last) ? k + 1 : first;
+				a += (pu(k) * pv(nx)) - (pu(nx) * pv(k));
+			}
+			return a * 0.5;
+		}
+
+		// The ring without the closing point, which repeats the first
+		uint32_t ringEnd(uint32_t first, uint32_t last) const
+		{
+			if (last - first > 1)
+			{
+				const double* a = &fVertices[(size_t)first * 3];
+				const double* b = &fVertices[(size_t)(last - 1) * 3];
+				if (a[0] == b[0] && a[1] == b[1] && a[2] == b[2])
+					return last - 1;
+			}
+			return last;
+		}
+
+		void projectPolygon(size_t firstPart, size_t lastPart)
+		{
+			// Newell's method for the normal of the outer ring
+			uint32_t first = (uint32_t)partStart(firstPart);
+			uint32_t last = ringEnd(first, (uint32_t)partEnd(firstPart));
+			double nx = 0, ny = 0, nz = 0;
+			for (uint32_t k = first; k < last; k++)
+			{
+				const double* a = &fVertices[(size_t)k * 3];
+				const double* b = &fVertices[(size_t)((k + 1 < last) ? k + 1 : first) * 3];
+				nx += (a[1] - b[1]) * (a[2] + b[2]);
+				ny += (a[2] - b[2]) * (a[0] + b[0]);
+				nz += (a[0] - b[0]) * (a[1] + b[1]);
+			}
+
+			// drop the axis the normal is most aligned with
+			int u = 0, v = 1;
+			if (std::fabs(nx) >= std::fabs(ny) && std::fabs(nx) >= std::fabs(nz)) { u = 1; v = 2; }
+			else if (std::fabs(ny) >= std::fabs(nz)) { u = 2; v = 0; }
+
+			uint32_t pFirst = (uint32_t)partStart(firstPart);
+			uint32_t pLast = (uint32_t)partEnd(lastPart - 1);
+			fPlaneScratch.resize((size_t)numPoints() * 2);
+			for (uint32_t k = pFirst; k < pLast; k++)
+			{
+				fPlaneScratch[(size_t)k * 2] = fVertices[((size_t)k * 3) + u];
+				fPlaneScratch[((size_t)k * 2) + 1] = fVertices[((size_t)k * 3) + v];
+			}
+		}
+
+		bool segmentsCross(uint32_t a, uint32_t b, uint32_t c, uint32_t d) const
+		{
+			double d1 = cross(pu(a), pv(a), pu(b), pv(b), pu(c), pv(c));
+			double d2 = cross(pu(a), pv(a), pu(b), pv(b), pu(d), pv(d));
+			double d3 = cross(pu(c), pv(c), pu(d), pv(d), pu(a), pv(a));
+			double d4 = cross(pu(c), pv(c), pu(d), pv(d), pu(b), pv(b));
+
+			return ((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0));
+		}
+
+		// true if p sits on the open segment a-b
+		bool onSegment(uint32_t a, uint32_t b, uint32_t p) const
+		{
+			if (cross(pu(a), pv(a), pu(b), pv(b), pu(p), pv(p)) != 0)
+				return false;
+			if ((pu(p) == pu(a) && pv(p) == pv(a)) || (pu(p) == pu(b) && pv(p) == pv(b)))
+				return false;
+
+			return std::min(pu(a), pu(b)) <= pu(p) && pu(p) <= std::max(pu(a), pu(b)) &&
+				std::min(pv(a), pv(b)) <= pv(p) && pv(p) <= std::max(pv(a), pv(b));
+		}
+
+		bool pointInTriangle(uint32_t a, uint32_t b, uint32_t c, uint32_t p) const
+		{
+			double px = pu(p), py = pv(p);
+			// vertices that sit on a corner (bridge duplicates) do not count
+			if ((px == pu(a) && py == pv(a)) || (px == pu(b) && py == pv(b)) || (px == pu(c) && py == pv(c)))
+				return false;
+
+			return cross(pu(a), pv(a), pu(b), pv(b), px, py) >= 0 &&
+				cross(pu(b), pv(b), pu(c), pv(c), px, py) >= 0 &&
+				cross(pu(c), pv(c), pu(a), pv(a), px, py) >= 0;
+		}
+
+		void triangulatePolygon(size_t firstPart, size_t lastPart)
+		{
+			projectPolygon(firstPart, lastPart);
+
+			uint32_t oFirst = (uint32_t)partStart(firstPart);
+			uint32_t oLast = ringEnd(oFirst, (uint32_t)partEnd(firstPart));
+			if (oLast - oFirst < 3)
+				return;
+
+			// Work counter-clockwise in the plane, and remember to flip
+			// the triangles back if the outer ring was the other way
+			bool flipped = ringArea(oFirst, oLast) < 0;
+
+			std::vector<uint32_t>& poly = fPolyScratch;
+			poly.clear();
+			for (uint32_t k = oFirst; k < oLast; k++)
+				poly.push_back(k);
+			if (flipped)
+				std::reverse(poly.begin(), poly.end());
+
+			// Holes are bridged in from the rightmost first, with the
+			// edges of holes not yet bridged kept as obstacles
+			std::vector<size_t>& holes = fHolePartScratch;
+			holes.clear();
+			for (size_t i = firstPart + 1; i < lastPart; i++)
+				if (ringEnd((uint32_t)partStart(i), (uint32_t)partEnd(i)) - (uint32_t)partStart(i) >= 3)
+					holes.push_back(i);
+
+			auto holeMaxU = [this](size_t part)
+				{
+					double m = -HUGE_VAL;
+					for (uint32_t k = (uint32_t)partStart(part); k < (uint32_t)partEnd(part); k++)
+						m = pu(k) > m ? pu(k) : m;
+					return m;
+				};
+			std::sort(holes.begin(), holes.end(), [&](size_t a, size_t b) { return holeMaxU(a) > holeMaxU(b); });
+
+			std::vector<uint32_t>& pending = fPendingScratch;
+			for (size_t hi = 0; hi < holes.size(); hi++)
+			{
+				pending.clear();
+				for (size_t hj = hi + 1; hj < holes.size(); hj++)
+				{
+					uint32_t f = (uint32_t)partStart(holes[hj]);
+					uint32_t l = ringEnd(f, (uint32_t)partEnd(holes[hj]));
+					for (uint32_t k = f; k < l; k++)
+					{
+						pending.push_back(k);
+						pending.push_back((k + 1 < l) ? k + 1 : f);
+					}
+				}
+
+				uint32_t hFirst = (uint32_t)partStart(holes[hi]);
+				uint32_t hLast = ringEnd(hFirst, (uint32_t)partEnd(holes[hi]));
+
+				// holes go the opposite way around from the outer ring
+				fHoleScratch.clear();
+				if (ringArea(hFirst, hLast) > 0)
+				{
+					for (uint32_t k = hLast; k > hFirst; k--)
+						fHoleScratch.push_back(k - 1);
+				}
+				else {
+					for (uint32_t k = hFirst; k < hLast; k++)
+						fHoleScratch.push_back(k);
+				}
+
+				bridgeHole(poly, fHoleScratch, pending);
+			}
+
+			clipEars(poly, flipped);
+		}
+
+		// Join a hole into the polygon, with a bridge from the hole's 
+		// rightmost vertex to the nearest polygon vertex that can 
+		// see it without crossing any edges
+		void bridgeHole(std::vector<uint32_t>& poly, const std::vector<uint32_t>& hole, const std::vector<uint32_t>& pendingEdges)
+		{
+			size_t hi = 0;
+			for (size_t k = 1; k < hole.size(); k++)
+				if (pu(hole[k]) > pu(hole[hi]))
+					hi = k;
+			uint32_t h = hole[hi];
+
+			size_t best = SIZE_MAX;
+			double bestDist = 0;
+			size_t n = poly.size();
+			for (size_t i = 0; i < n; i++)
+			{
+				uint32_t p = poly[i];
+				double du = pu(p) - pu(h);
+				double dv = pv(p) - pv(h);
+				double dist = (du * du) + (dv * dv);
+				if (best != SIZE_MAX && dist >= bestDist)
+					continue;
+
+				// A vertex that shows up more than once (from an earlier 
+				// bridge) only takes the bridge in the corner it opens into
+				uint32_t pa = poly[(i + n - 1) % n];
+				uint32_t pc = poly[(i + 1) % n];
+				double ta = cross(pu(pa), pv(pa), pu(p), pv(p), pu(h), pv(h));
+				double tc = cross(pu(p), pv(p), pu(pc), pv(pc), pu(h), pv(h));
+				bool convex = cross(pu(pa), pv(pa), pu(p), pv(p), pu(pc), pv(pc)) >= 0;
+				if (convex ? (ta <= 0 || tc <= 0) : (ta <= 0 && tc <= 0))
+					continue;
+
+				// The bridge may not cross an edge, nor graze a vertex on 
+				// the way, which would let it slip through a corner of the hole
+				bool blocked = false;
+				for (size_t j = 0; j < n && !blocked; j++)
+					blocked = segmentsCross(h, p, poly[j], poly[(j + 1) % n]) || onSegment(h, p, poly[j]);
+				for (size_t j = 0; j < hole.size() && !blocked; j++)
+					blocked = segmentsCross(h, p, hole[j], hole[(j + 1) % hole.size()]) || onSegment(h, p, hole[j]);
+				for (size_t j = 0; j + 1 < pendingEdges.size() && !blocked; j += 2)
+					blocked = segmentsCross(h, p, pendingEdges[j], pendingEdges[j + 1]) || onSegment(h, p, pendingEdges[j]);
+
+				if (!blocked)
+				{
+					best = i;
+					bestDist = dist;
+				}
+			}
+
+			if (best == SIZE_MAX)
+				best = 0;
+
+			std::vector<uint32_t>& splice = fSpliceScratch;
+			splice.clear();
+			for (size_t k = 0; k <= hole.size(); k++)
+				splice.push_back(hole[(hi + k) % hole.size()]);
+			splice.push_back(poly[best]);
+			poly.insert(poly.begin() + best + 1, splice.begin(), splice.end());
+		}
+
+		void clipEars(std::vector<uint32_t>& poly, bool flipped)
+		{
+			auto emit = [&](uint32_t a, uint32_t b, uint32_t c)
+				{
+					if (flipped)
+						addTriangle(a, c, b);
+					else
+						addTriangle(a, b, c);
+				};
+
+			size_t n = poly.size();
+			size_t misses = 0;
+			size_t i = 0;
+			while (n > 3)
+			{
+				size_t ip = (i + n - 1) % n;
+				size_t in = (i + 1) % n;
+				uint32_t a = poly[ip], b = poly[i], c = poly[in];
+
+				bool isEar = cross(pu(a), pv(a), pu(b), pv(b), pu(c), pv(c)) > 0;
+				for (size_t k = 0; k < n && isEar; k++)
+				{
+					if (k == ip || k == i || k == in)
+						continue;
+					if (pointInTriangle(a, b, c, poly[k]))
+						isEar = false;
+				}
+
+				// If we've gone all the way around without finding an ear,
+				// the polygon is degenerate (or self intersecting), so take
+				// the vertex anyway, to guarantee we finish
+				if (isEar || misses >= n)
+				{
+					emit(a, b, c);
+					poly.erase(poly.begin() + i);
+					n--;
+					misses = 0;
+					if (i >= n)
+						i = 0;
+				}
+				else {
+					misses++;
+					i = (i + 1) % n;
+				}
+			}
+
+			if (n == 3)
+				emit(poly[0], poly[1], poly[2]);
+		}
+	};
+}
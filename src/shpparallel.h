@@ -0,0 +1,53 @@
+#pragma once
+
+//
+// shpParallelFor
+//
+// Split [0, count) into one contiguous range per thread, and call
+// fn(first, last) on each, from its own thread.  Returns when they're
+// all done.  With only one thread's worth of work, fn is called on the
+// whole range, on the calling thread, and no thread is started.
+//
+// nThreads == 0 means use all the hardware threads.  A thread is only
+// added for each 'minPerThread' items, so small jobs don't pay for
+// starting threads that have next to nothing to do.
+//
+// Usage:
+//	shpParallelFor(table.size(), 0, 4096, [&](size_t first, size_t last) {
+//		for (size_t i = first; i < last; i++)
+//			out[i] = work(table.at(i));
+//	});
+//
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+
+namespace waavs {
+	template <typename Fn>
+	static void shpParallelFor(size_t count, unsigned nThreads, size_t minPerThread, Fn&& fn)
+	{
+		if (nThreads == 0)
+			nThreads = std::thread::hardware_concurrency();
+		if (minPerThread > 0 && nThreads > count / minPerThread)
+			nThreads = (unsigned)(count / minPerThread);
+
+		if (nThreads <= 1)
+		{
+			fn((size_t)0, count);
+			return;
+		}
+
+		std::vector<std::thread> workers;
+		size_t per = (count + nThreads - 1) / nThreads;
+		for (size_t first = 0; first < count; first += per)
+		{
+			size_t last = (first + per) < count ? (first + per) : count;
+			workers.emplace_back([&fn, first, last]() { fn(first, last); });
+		}
+
+		for (auto& w : workers)
+			w.join();
+	}
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+//
+// Decode, project, emit, in one pass
+//
+// Exporting a record's points is three steps, read the coordinates out
+// of the record, project them, and write them out.  Doing each step over
+// the whole record means a full copy of the coordinates in between, that
+// gets written once, and read back again.
+//
+// shpProjectEmit() instead takes the points a block at a time.  A block
+// is read straight out of the record content, into a pair of small
+// arrays on the stack, projected there, in place, and handed to the
+// emitter while it's still in L1.  Nothing is allocated, and each point
+// is read from the record once, and written to the output once.
+//
+// The projection is anything callable as
+//	project(double* x, double* y, size_t n)
+// which replaces the coordinates in x[] and y[] with projected ones.
+// The emitter is anything callable as
+//	emit(const double* x, const double* y, size_t n)
+//
+// Blocks are kShpPipelineBlock points, enough for the batch projections
+// to work at full width, and small enough to stay in L1.
+//
+// shpEmitOrdered() formats the records in parallel, and writes them out
+// in their original order, so the output is the same, byte for byte, as
+// formatting them one after another.  The records are cut into chunks
+// of kShpEmitChunk.  Worker threads take the next chunk, and format it
+// into a memory SvgWriter of their own.  The calling thread writes the
+// chunks out as they complete, in order.  Workers only run so far ahead
+// of the writing, so the buffers are reused, and memory stays bounded
+// however big the file is.
+//
+// Usage:
+//	shpProjectEmit(ring,
+//		[](double* x, double* y, size_t n) { proj.forward(x, y, x, y, n); },
+//		[&](const double* x, const double* y, size_t n) { writer.points(x, y, n); });
+//
+//	shpEmitOrdered(table.size(), 0, out, [&](SvgWriter& w, size_t first, size_t last) {
+//		for (size_t i = first; i < last; i++)
+//			printRecord(w, table.at(i));
+//	});
+//
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "definitions.h"
+#include "shpview.h"
+#include "svgwriter.h"
+
+
+namespace waavs {
+	static constexpr size_t kShpPipelineBlock = 256;
+
+	// Copy count points, starting at first, out of the record, as separate
+	// x and y arrays
+	static INLINE void shpLoadPoints(const ShpPointArray& pts, size_t first, size_t count, double* xs, double* ys) noexcept
+	{
+		const uint8_t* p = pts.data() + (first * 16);
+		for (size_t i = 0; i < count; i++)
+		{
+			xs[i] = as_f64_le(p);
+			ys[i] = as_f64_le(p + 8);
+			p += 16;
+		}
+	}
+
+	// Stream the points through the projection, to the emitter
+	template <typename Project, typename Emit>
+	static INLINE void shpProjectEmit(const ShpPointArray& pts, Project&& project, Emit&& emit)
+	{
+		alignas(32) double xs[kShpPipelineBlock];
+		alignas(32) double ys[kShpPipelineBlock];
+
+		for (size_t first = 0; first < pts.size(); first += kShpPipelineBlock)
+		{
+			size_t remaining = pts.size() - first;
+			size_t count = remaining < kShpPipelineBlock ? remaining : kShpPipelineBlock;
+
+			shpLoadPoints(pts, first, count, xs, ys);
+			project(xs, ys, count);
+			emit((const double*)xs, (const double*)ys, count);
+		}
+	}
+
+	static constexpr size_t kShpEmitChunk = 64;			// records per chunk
+	static constexpr size_t kShpEmitChunksPerThread = 4;	// how far ahead of the writing
+	static constexpr size_t kShpEmitBufferSize = 64 * 1024;
+
+	// Call fn(writer, first, last) on ranges of [0, count), on up to nThreads
+	// threads, and write what each one produces to 'out', in order.
+	// nThreads == 0 means use all the hardware threads.
+	template <typename Fn>
+	static void shpEmitOrdered(size_t count, unsigned nThreads, SvgWriter& out, Fn&& fn)
+	{
+		if (nThreads == 0)
+			nThreads = std::thread::hardware_concurrency();
+
+		size_t numChunks = (count + kShpEmitChunk - 1) / kShpEmitChunk;
+		if (nThreads > numChunks)
+			nThreads = (unsigned)numChunks;
+
+		if (nThreads <= 1)
+		{
+			fn(out, (size_t)0, count);
+			return;
+		}
+
+		// chunk c is formatted into slot (c % window), which is free
+		// once chunk (c - window) has been written
+		const size_t window = (size_t)nThreads * kShpEmitChunksPerThread;
+		std::vector<std::unique_ptr<SvgWriter>> slots;
+		for (size_t i = 0; i < window; i++)
+		{
+			slots.push_back(std::make_unique<SvgWriter>(SvgWriter::kMemory, kShpEmitBufferSize));
+			slots.back()->setPrecision(out.precision());
+		}
+		std::vector<uint8_t> ready(window, 0);
+
+		std::mutex lock;
+		std::condition_variable workAvailable;
+		std::condition_variable chunkReady;
+		size_t nextChunk = 0;
+		size_t written = 0;
+
+		auto worker = [&]() {
+			while (true)
+			{
+				size_t c;
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					workAvailable.wait(guard, [&]() { return nextChunk >= numChunks || nextChunk < written + window; });
+					if (nextChunk >= numChunks)
+						return;
+					c = nextChunk++;
+				}
+
+				SvgWriter& w = *slots[c % window];
+				w.clear();
+				size_t first = c * kShpEmitChunk;
+				size_t last = (first + kShpEmitChunk) < count ? (first + kShpEmitChunk) : count;
+				fn(w, first, last);
+
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					ready[c % window] = 1;
+				}
+				chunkReady.notify_one();
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (unsigned i = 0; i < nThreads; i++)
+			workers.emplace_back(worker);
+
+		for (size_t c = 0; c < numChunks; c++)
+		{
+			size_t slot = c % window;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				chunkReady.wait(guard, [&]() { return ready[slot] != 0; });
+				ready[slot] = 0;
+			}
+
+			out.write(slots[slot]->data(), slots[slot]->pending());
+
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				written = c + 1;
+			}
+			workAvailable.notify_all();
+		}
+
+		for (auto& w : workers)
+			w.join();
+	}
+}
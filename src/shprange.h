@@ -0,0 +1,175 @@
+#pragma once
+
+//
+// Lazy ranges over the records in a '.shp' file
+// 
+// ShpFile builds a table of every record up front.  When the records
+// are only going to be visited once, that table is wasted memory and
+// startup time.  These views instead parse each record header straight
+// from the mapped bytes, as the iteration reaches it.
+// 
+// They are C++20 views, so they compose with std::views
+// 
+//	for (const ShpRecord& rec : shpRecords(fileBytes) 
+//		| std::views::filter([](const ShpRecord& r) { return r.shapeType() == ShpShapeType::Polygon; })
+//		| std::views::take(100))
+//	{
+//		...
+//	}
+// 
+// ShpRecordRange
+//	A forward range, which walks the records one after the other.
+//	Iteration stops at the end of the file, or at the first record
+//	that is malformed.
+// 
+// ShpIndexedRecordRange
+//	A random access range, driven by a ShxIndex, so going to record
+//	N, or std::views::drop(N), is O(1).
+//
+
+#include <cstdint>
+#include <iterator>
+#include <ranges>
+
+#include "bspan.h"
+#include "shptypes.h"
+#include "shapefile.h"
+
+
+namespace waavs {
+	struct ShpRecordRange : public std::ranges::view_interface<ShpRecordRange>
+	{
+		struct iterator
+		{
+			using iterator_concept = std::forward_iterator_tag;
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = ShpRecord;
+			using difference_type = std::ptrdiff_t;
+			using reference = const ShpRecord&;
+			using pointer = const ShpRecord*;
+
+			ByteSpan fRemaining{};		// bytes after the current record
+			const uint8_t* fPos{ nullptr };	// start of the current record, nullptr at the end
+			ShpRecord fCurrent{};
+
+			iterator() = default;
+			explicit iterator(const ByteSpan& records)
+				: fRemaining(records)
+			{
+				advance();
+			}
+
+			const ShpRecord& operator*() const { return fCurrent; }
+			const ShpRecord* operator->() const { return &fCurrent; }
+
+			iterator& operator++() { advance(); return *this; }
+			iterator operator++(int) { iterator tmp = *this; advance(); return tmp; }
+
+			bool operator==(const iterator& other) const { return fPos == other.fPos; }
+			bool operator==(std::default_sentinel_t) const { return fPos == nullptr; }
+
+		private:
+			void advance()
+			{
+				if (fRemaining.empty())
+				{
+					fPos = nullptr;
+					return;
+				}
+
+				fPos = fRemaining.data();
+				if (!fCurrent.readFromStream(fRemaining))
+				{
+					fPos = nullptr;
+					fRemaining = {};
+				}
+			}
+		};
+
+		ByteSpan fRecords{};	// the bytes following the 100 byte file header
+
+		ShpRecordRange() = default;
+		explicit ShpRecordRange(const ByteSpan& records) : fRecords(records) {}
+
+		iterator begin() const { return iterator(fRecords); }
+		std::default_sentinel_t end() const { return std::default_sentinel; }
+	};
+
+
+	struct ShpIndexedRecordRange : public std::ranges::view_interface<ShpIndexedRecordRange>
+	{
+		struct iterator
+		{
+			using iterator_concept = std::random_access_iterator_tag;
+			using iterator_category = std::input_iterator_tag;
+			using value_type = ShpRecord;
+			using difference_type = std::ptrdiff_t;
+			using reference = ShpRecord;
+
+			const ShpIndexedRecordRange* fRange{ nullptr };
+			size_t fIndex{ 0 };
+
+			iterator() = default;
+			iterator(const ShpIndexedRecordRange* range, size_t idx) : fRange(range), fIndex(idx) {}
+
+			ShpRecord operator*() const { return fRange->at(fIndex); }
+			ShpRecord operator[](difference_type n) const { return fRange->at(fIndex + n); }
+
+			iterator& operator++() { ++fIndex; return *this; }
+			iterator operator++(int) { iterator tmp = *this; ++fIndex; return tmp; }
+			iterator& operator--() { --fIndex; return *this; }
+			iterator operator--(int) { iterator tmp = *this; --fIndex; return tmp; }
+			iterator& operator+=(difference_type n) { fIndex += n; return *this; }
+			iterator& operator-=(difference_type n) { fIndex -= n; return *this; }
+			iterator operator+(difference_type n) const { return { fRange, fIndex + n }; }
+			iterator operator-(difference_type n) const { return { fRange, fIndex - n }; }
+			friend iterator operator+(difference_type n, const iterator& it) { return it + n; }
+			difference_type operator-(const iterator& other) const { return (difference_type)fIndex - (difference_type)other.fIndex; }
+
+			bool operator==(const iterator& other) const { return fIndex == other.fIndex; }
+			auto operator<=>(const iterator& other) const { return fIndex <=> other.fIndex; }
+		};
+
+		ByteSpan fFile{};					// the whole .shp, including the header
+		const ShxIndex* fIndex{ nullptr };
+
+		ShpIndexedRecordRange() = default;
+		ShpIndexedRecordRange(const ByteSpan& file, const ShxIndex& idx) : fFile(file), fIndex(&idx) {}
+
+		size_t size() const { return fIndex ? fIndex->recordCount() : 0; }
+
+		// Jump straight to a record, by 0 based index
+		// If the index is past the end of the index, or does not point
+		// at a well formed record, a NullShape record with empty content
+		// is returned
+		ShpRecord at(size_t idx) const
+		{
+			if (idx >= size())
+				return ShpRecord(idx + 1, {}, ShpShapeType::NullShape);
+
+			ShpRecord rec{};
+			ByteSpan bs = fFile.subSpan(fIndex->recordOffset(idx), fIndex->contentSize(idx) + 8);
+			if (!rec.readFromStream(bs))
+				return ShpRecord(idx + 1, {}, ShpShapeType::NullShape);
+
+			return rec;
+		}
+
+		iterator begin() const { return { this, 0 }; }
+		iterator end() const { return { this, size() }; }
+	};
+
+
+	// Records of a .shp file, parsed as they are reached
+	// 'file' is the entire .shp, including the 100 byte header
+	static inline ShpRecordRange shpRecords(const ByteSpan& file)
+	{
+		return ShpRecordRange(file.subSpan(100, file.size()));
+	}
+
+	// Records of a .shp file, in index order, with O(1) access to any record
+	static inline ShpIndexedRecordRange shpRecords(const ByteSpan& file, const ShxIndex& idx)
+	{
+		return ShpIndexedRecordRange(file, idx);
+	}
+}
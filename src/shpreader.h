@@ -0,0 +1,230 @@
+#pragma once
+
+//
+// ShpStreamReader
+// 
+// A bounded memory reader for '.shp' content.  Where ShpFile
+// wants the whole file as one contiguous ByteSpan (typically a MappedFile)
+// this reader pulls bytes through a fixed size window that is reused
+// for every record.  Only a single record is ever handed out at a time, 
+// and its content span points into the window, so it is only valid
+// until the next call to next().
+//
+// Since the reader only ever moves forward, with plain fread() calls, 
+// it works just as well on stdin, or the output of a decompression
+// pipe, as it does on a regular file.
+//
+// Usage:
+//	ShpStreamReader reader(stdin);
+//	if (!reader.readHeader())
+//		return;
+//
+//	ShpRecord rec;
+//	while (reader.next(rec))
+//	{
+//		// do something with rec.content()
+//	}
+//
+// On Windows, stdin needs to be put into binary mode, with _setmode(), 
+// before handing it to the reader.
+//
+// The size of a record comes from the stream, so it can't be trusted.
+// A record that runs past the file length given in the header, or is
+// bigger than maxRecordSize(), stops the reading with an error, rather
+// than growing the window to whatever size it claims.
+//
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "bspan.h"
+#include "shapefile.h"
+
+
+namespace waavs {
+	struct ShpStreamReader
+	{
+		static constexpr size_t kDefaultWindowSize = 4 * 1024 * 1024;
+		static constexpr size_t kHeaderSize = 100;
+		static constexpr size_t kRecordHeaderSize = 8;
+		static constexpr size_t kDefaultMaxRecordSize = 256 * 1024 * 1024;
+
+		FILE* fFile{ nullptr };
+		std::vector<uint8_t> fWindow{};
+		size_t fBegin{ 0 };		// first byte in the window not yet consumed
+		size_t fEnd{ 0 };		// one past the last valid byte in the window
+		uint64_t fOffset{ 0 };	// file offset of fBegin
+		size_t fMaxRecordSize{ kDefaultMaxRecordSize };
+		bool fAtEOF{ false };
+		bool fHasError{ false };
+
+		ShapefileHeader fHeader{ "" };
+
+		// The FILE is not owned by the reader, the caller
+		// remains responsible for closing it.
+		ShpStreamReader(FILE* f, size_t windowSize = kDefaultWindowSize)
+			: fFile(f)
+		{
+			if (windowSize < kHeaderSize)
+				windowSize = kHeaderSize;
+			fWindow.resize(windowSize);
+		}
+
+		ShpStreamReader(const ShpStreamReader& other) = delete;
+		ShpStreamReader& operator=(const ShpStreamReader& other) = delete;
+
+		const ShapefileHeader& header() const { return fHeader; }
+
+		// The file offset of the next record to be read
+		uint64_t offset() const { return fOffset; }
+		
+		// The size of the window.  This will only grow beyond the size
+		// given in the constructor if a single record is bigger than that.
+		size_t windowSize() const { return fWindow.size(); }
+
+		// The largest record, in bytes, the window will grow to hold
+		size_t maxRecordSize() const { return fMaxRecordSize; }
+		void setMaxRecordSize(size_t size) { fMaxRecordSize = size; }
+
+		// true if reading stopped because of a read error, 
+		// or truncated/malformed record, rather than a clean end of file
+		bool hasError() const { return fHasError; }
+
+		// Read the 100 byte file header
+		// This must be called before the first call to next()
+		bool readHeader()
+		{
+			if (!fill(kHeaderSize))
+				return false;
+
+			ByteSpan bs(fWindow.data() + fBegin, kHeaderSize);
+			if (!fHeader.readFromStream(bs))
+			{
+				fHasError = true;
+				return false;
+			}
+
+			consume(kHeaderSize);
+
+			return true;
+		}
+
+		// Get the next record
+		// The record's content() is only valid until the next 
+		// call to next()
+		bool next(ShpRecord& rec)
+		{
+			if (!fill(kRecordHeaderSize))
+			{
+				// A clean end of file lands exactly on a record boundary
+				if (available() > 0)
+					fHasError = true;
+				return false;
+			}
+
+			// peek at the content length, so we know how much 
+			// needs to be in the window for the whole record
+			size_t contentSize = (size_t)as_u32_be(fWindow.data() + fBegin + 4) * 2;
+			size_t recordSize = contentSize + kRecordHeaderSize;
+
+			if (!recordFits(recordSize))
+			{
+				fHasError = true;
+				return false;
+			}
+
+			if (recordSize > fWindow.size())
+				grow(recordSize);
+
+			if (!fill(recordSize))
+			{
+				fHasError = true;
+				return false;
+			}
+
+			ByteSpan bs(fWindow.data() + fBegin, recordSize);
+			if (!rec.readFromStream(bs))
+			{
+				fHasError = true;
+				return false;
+			}
+
+			consume(recordSize);
+
+			return true;
+		}
+
+	private:
+		size_t available() const { return fEnd - fBegin; }
+
+		// Whether a record of this size, at the current offset, is one
+		// that could be in the file.  A header length too small to hold
+		// any records isn't taken as the limit, it's likely just unset.
+		bool recordFits(size_t recordSize) const
+		{
+			if (recordSize > fMaxRecordSize)
+				return false;
+
+			uint64_t fileSize = (uint64_t)(uint32_t)fHeader.fileLength * 2;
+			if (fileSize > kHeaderSize && (fOffset + recordSize) > fileSize)
+				return false;
+
+			return true;
+		}
+
+		void consume(size_t n)
+		{
+			fBegin += n;
+			fOffset += n;
+		}
+
+		// Grow the window so it can hold a single record that is
+		// bigger than the current window
+		void grow(size_t needed)
+		{
+			compact();
+			fWindow.resize(needed);
+		}
+
+		// Move whatever has not been consumed to the front of the window
+		void compact()
+		{
+			size_t n = available();
+			if (fBegin > 0 && n > 0)
+				memmove(fWindow.data(), fWindow.data() + fBegin, n);
+			fBegin = 0;
+			fEnd = n;
+		}
+
+		// Make sure there are at least 'needed' bytes in the window
+		// Since the window is refilled with as much as will fit, 
+		// this only goes to the file once for many records.
+		bool fill(size_t needed)
+		{
+			if (available() >= needed)
+				return true;
+
+			compact();
+
+			while (!fAtEOF && (fEnd < fWindow.size()))
+			{
+				size_t got = fread(fWindow.data() + fEnd, 1, fWindow.size() - fEnd, fFile);
+				fEnd += got;
+
+				if (got == 0)
+				{
+					fAtEOF = true;
+					if (ferror(fFile))
+						fHasError = true;
+				}
+				else if (available() >= needed) {
+					break;
+				}
+			}
+
+			return available() >= needed;
+		}
+	};
+}
@@ -0,0 +1,373 @@
+#pragma once
+
+//
+// Parallel scanning of '.shp' record headers
+// 
+// ShpFile::readSelfFromStream() walks the record headers one after
+// the other, because the position of each record depends on the
+// length of the record before it.  The routines here build the same
+// ShpRecordTable using multiple threads.
+// 
+// scanRecordsIndexed()
+//	When there is a '.shx', every record offset is already known, so
+//	the index is split into ranges, and each thread validates the record
+//	headers in its range, filling in its own slots of the table.
+//
+// scanRecordsSpeculative()
+//	Without an index, the file is split into byte ranges.  Each thread
+//	guesses where the first record in its range begins, by looking
+//	for a chain of plausible record headers, then scans from there.
+//	The ranges are then stitched together in order, checking that each
+//	range began exactly where the previous one ended.  A range that 
+//	guessed wrong is simply rescanned sequentially from the right spot, 
+//	so a bad guess costs time, never correctness.
+//
+// Usage:
+//	ShpFile shp(filename);
+//	ShxIndex shx;		// optional
+//	if (!readShpFileParallel(shp, shpBytes, &shx))
+//		return;
+//
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "bspan.h"
+#include "shptypes.h"
+#include "shapefile.h"
+#include "converters.h"
+
+
+namespace waavs {
+	static constexpr size_t kShpHeaderSize = 100;
+	static constexpr size_t kShpRecordHeaderSize = 8;
+
+	// Below this many bytes, spinning up threads costs more than it saves
+	static constexpr size_t kShpParallelScanMinBytes = 1024 * 1024;
+
+	static unsigned shpScanThreadCount(unsigned requested, size_t work) noexcept
+	{
+		unsigned n = requested;
+		if (n == 0)
+			n = std::thread::hardware_concurrency();
+		if (n == 0)
+			n = 1;
+		if (work < n)
+			n = (unsigned)(work > 0 ? work : 1);
+
+		return n;
+	}
+
+	// Read the header of the record that starts at 'offset' in the file
+	// Returns false if the record header, or its content, would go
+	// past the end of the file
+	static bool shpReadRecordHeader(const ByteSpan& file, size_t offset, 
+		uint32_t& recordNum, uint32_t& contentSize, int32_t& kind) noexcept
+	{
+		if (offset > file.size() || file.size() - offset < kShpRecordHeaderSize)
+			return false;
+
+		const uint8_t* p = file.data() + offset;
+		recordNum = as_u32_be(p);
+		contentSize = as_u32_be(p + 4) * 2;
+
+		if (file.size() - offset - kShpRecordHeaderSize < contentSize)
+			return false;
+
+		kind = (contentSize >= 4) ? (int32_t)as_u32_le(p + 8) : 0;
+
+		return true;
+	}
+
+	//
+	// scanRecordsIndexed()
+	// 
+	// Fill in the record table from the offsets in the index.
+	// Each record header is checked to have the expected record number
+	// and content length, and to fit within the file.
+	//
+	static bool scanRecordsIndexed(const ByteSpan& file, const ShxIndex& idx, ShpRecordTable& table, unsigned nThreads = 0)
+	{
+		size_t count = idx.recordCount();
+		table.base(file.data());
+		table.resize(count);
+
+		if (file.size() < kShpParallelScanMinBytes)
+			nThreads = 1;
+		nThreads = shpScanThreadCount(nThreads, count);
+
+		std::vector<uint8_t> ok(nThreads, 1);
+
+		auto scanRange = [&](unsigned t, size_t first, size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+				{
+					uint32_t recNum{ 0 };
+					uint32_t cSize{ 0 };
+					int32_t kind{ 0 };
+
+					size_t offset = idx.recordOffset(i);
+					if (!shpReadRecordHeader(file, offset, recNum, cSize, kind) ||
+						(recNum != i + 1) || (cSize != idx.contentSize(i)) ||
+						(offset + kShpRecordHeaderSize > UINT32_MAX))
+					{
+						ok[t] = 0;
+						return;
+					}
+
+					table.setRecord(i, (uint32_t)(offset + kShpRecordHeaderSize), cSize, (ShpShapeType)kind);
+				}
+			};
+
+		if (nThreads == 1)
+		{
+			scanRange(0, 0, count);
+		}
+		else {
+			std::vector<std::thread> workers;
+			size_t per = (count + nThreads - 1) / nThreads;
+			for (unsigned t = 0; t < nThreads; t++)
+			{
+				size_t first = t * per;
+				size_t last = (first + per) < count ? (first + per) : count;
+				if (first >= last)
+					break;
+				workers.emplace_back(scanRange, t, first, last);
+			}
+
+			for (auto& w : workers)
+				w.join();
+		}
+
+		for (auto v : ok)
+		{
+			if (!v)
+			{
+				table.clear();
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+
+	//
+	// ShpScanChunk
+	// The result of scanning one byte range of the file
+	//
+	struct ShpScanChunk
+	{
+		size_t fStart{ 0 };		// offset of the first record found in the range
+		size_t fStop{ 0 };		// offset of the first record past the range
+		bool fFound{ false };	// whether a starting record was found at all
+		std::vector<uint32_t> fOffsets{};
+		std::vector<uint32_t> fLengths{};
+		std::vector<uint8_t> fTypes{};
+
+		void clear()
+		{
+			fOffsets.clear();
+			fLengths.clear();
+			fTypes.clear();
+		}
+
+		// Walk records sequentially, from 'offset' until we reach a
+		// record that starts at or beyond 'limit'
+		// Returns false if a malformed record is found along the way
+		bool scan(const ByteSpan& file, size_t offset, size_t limit)
+		{
+			while (offset < limit && offset < file.size())
+			{
+				uint32_t recNum{ 0 };
+				uint32_t cSize{ 0 };
+				int32_t kind{ 0 };
+
+				if (!shpReadRecordHeader(file, offset, recNum, cSize, kind))
+					return false;
+
+				if (offset + kShpRecordHeaderSize > UINT32_MAX)
+					return false;
+
+				fOffsets.push_back((uint32_t)(offset + kShpRecordHeaderSize));
+				fLengths.push_back(cSize);
+				fTypes.push_back(shpPackShapeType(kind));
+
+				offset += kShpRecordHeaderSize + cSize;
+			}
+
+			fStop = offset;
+
+			return true;
+		}
+	};
+
+	// Decide whether a record plausibly begins at 'offset'
+	// Beyond the header itself looking sane, the next few records
+	// must chain on from it, with sequential record numbers, or the 
+	// chain must land exactly on the end of the file.
+	static bool shpIsPlausibleRecordStart(const ByteSpan& file, size_t offset, int32_t fileShapeType) noexcept
+	{
+		static constexpr int kChainLength = 4;
+
+		uint32_t expectNum{ 0 };
+		for (int i = 0; i < kChainLength; i++)
+		{
+			if (offset == file.size())
+				return i > 0;
+
+			uint32_t recNum{ 0 };
+			uint32_t cSize{ 0 };
+			int32_t kind{ 0 };
+
+			if (!shpReadRecordHeader(file, offset, recNum, cSize, kind))
+				return false;
+
+			if (recNum == 0 || cSize < 4)
+				return false;
+
+			if (i > 0 && recNum != expectNum)
+				return false;
+
+			// All the non-null shapes in a file are supposed to be
+			// of the same type as the file header says
+			if (!shpIsShapeType(kind) ||
+				((kind != (int32_t)ShpShapeType::NullShape) && (kind != fileShapeType)))
+				return false;
+
+			expectNum = recNum + 1;
+			offset += kShpRecordHeaderSize + cSize;
+		}
+
+		return true;
+	}
+
+	//
+	// scanRecordsSpeculative()
+	// 
+	// Build the record table without the benefit of an index.
+	// 'file' is the whole .shp file, including the 100 byte header
+	//
+	static bool scanRecordsSpeculative(const ByteSpan& file, ShpRecordTable& table, unsigned nThreads = 0)
+	{
+		table.clear();
+		table.base(file.data());
+
+		if (file.size() < kShpHeaderSize)
+			return false;
+
+		int32_t fileShapeType = (int32_t)as_u32_le(file.data() + 32);
+		size_t body = file.size() - kShpHeaderSize;
+
+		if (file.size() < kShpParallelScanMinBytes)
+			nThreads = 1;
+		nThreads = shpScanThreadCount(nThreads, body / kShpRecordHeaderSize);
+
+		std::vector<ShpScanChunk> chunks(nThreads);
+		std::vector<size_t> limits(nThreads);
+
+		size_t per = body / nThreads;
+		per += per & 1;		// records always start on an even offset
+		for (unsigned t = 0; t < nThreads; t++)
+			limits[t] = (t + 1 == nThreads) ? file.size() : kShpHeaderSize + (per * (t + 1));
+
+		auto scanChunk = [&](unsigned t)
+			{
+				ShpScanChunk& chunk = chunks[t];
+				size_t begin = kShpHeaderSize + (per * t);
+				size_t limit = limits[t];
+
+				// The first chunk knows exactly where it starts
+				if (t > 0)
+				{
+					while (begin < limit && !shpIsPlausibleRecordStart(file, begin, fileShapeType))
+						begin += 2;
+				}
+
+				if (begin >= limit)
+					return;
+
+				chunk.fStart = begin;
+				chunk.fFound = chunk.scan(file, begin, limit);
+				if (!chunk.fFound)
+					chunk.clear();
+			};
+
+		if (nThreads == 1)
+		{
+			scanChunk(0);
+		}
+		else {
+			std::vector<std::thread> workers;
+			for (unsigned t = 0; t < nThreads; t++)
+				workers.emplace_back(scanChunk, t);
+			for (auto& w : workers)
+				w.join();
+		}
+
+		// Stitch the chunks together, verifying each one started
+		// where the previous one stopped.  Any that did not, get 
+		// rescanned from the correct position.
+		size_t expected = kShpHeaderSize;
+		for (unsigned t = 0; t < nThreads; t++)
+		{
+			ShpScanChunk& chunk = chunks[t];
+
+			if (!chunk.fFound || chunk.fStart != expected)
+			{
+				chunk.clear();
+				chunk.fStart = expected;
+				if (!chunk.scan(file, expected, limits[t]))
+				{
+					table.clear();
+					return false;
+				}
+			}
+
+			expected = chunk.fStop > expected ? chunk.fStop : expected;
+		}
+
+		if (expected != file.size())
+		{
+			table.clear();
+			return false;
+		}
+
+		size_t total = 0;
+		for (auto& chunk : chunks)
+			total += chunk.fOffsets.size();
+
+		table.reserve(total);
+		for (auto& chunk : chunks)
+		{
+			table.fOffsets.insert(table.fOffsets.end(), chunk.fOffsets.begin(), chunk.fOffsets.end());
+			table.fLengths.insert(table.fLengths.end(), chunk.fLengths.begin(), chunk.fLengths.end());
+			table.fTypes.insert(table.fTypes.end(), chunk.fTypes.begin(), chunk.fTypes.end());
+		}
+
+		return true;
+	}
+
+	//
+	// readShpFileParallel()
+	// 
+	// Read the header of a .shp file, then build its record table
+	// in parallel.  If an index is given, it drives the scan, otherwise
+	// a speculative scan is done.  If the index turns out not to match
+	// the content, the speculative scan is used instead.
+	//
+	static bool readShpFileParallel(ShpFile& shp, const ByteSpan& file, const ShxIndex* idx = nullptr, unsigned nThreads = 0)
+	{
+		// Only hand the header to the ShpFile, so it does not
+		// do its own sequential scan of the records
+		ByteSpan hdr = file.take(kShpHeaderSize);
+		if (!shp.readFromStream(hdr))
+			return false;
+
+		if (idx != nullptr && scanRecordsIndexed(file, *idx, shp.fRecords, nThreads))
+			return true;
+
+		return scanRecordsSpeculative(file, shp.fRecords, nThreads);
+	}
+}
@@ -23,4 +23,80 @@ namespace waavs
 		MultiPatch = 31
 	};
 
+	// The 2D shape type that a Z or M variant extends
+	// The x/y portion of a PolygonZ is laid out exactly like a Polygon, 
+	// and so on, so code that only cares about x/y can switch on this.
+	static constexpr ShpShapeType shpBaseType(ShpShapeType kind) noexcept
+	{
+		switch (kind)
+		{
+		case ShpShapeType::PointZ:
+		case ShpShapeType::PointM:
+			return ShpShapeType::Point;
+		case ShpShapeType::PolyLineZ:
+		case ShpShapeType::PolyLineM:
+			return ShpShapeType::PolyLine;
+		case ShpShapeType::PolygonZ:
+		case ShpShapeType::PolygonM:
+			return ShpShapeType::Polygon;
+		case ShpShapeType::MultiPointZ:
+		case ShpShapeType::MultiPointM:
+			return ShpShapeType::MultiPoint;
+		default:
+			return kind;
+		}
+	}
+
+	static constexpr bool shpHasZ(ShpShapeType kind) noexcept
+	{
+		return kind == ShpShapeType::PointZ || kind == ShpShapeType::PolyLineZ ||
+			kind == ShpShapeType::PolygonZ || kind == ShpShapeType::MultiPointZ ||
+			kind == ShpShapeType::MultiPatch;
+	}
+
+	// Whether the shape type has an M block.  For the Z types, and 
+	// MultiPatch, the M block is optional, and may be left off the end
+	// of the record.
+	static constexpr bool shpHasM(ShpShapeType kind) noexcept
+	{
+		return kind == ShpShapeType::PointM || kind == ShpShapeType::PolyLineM ||
+			kind == ShpShapeType::PolygonM || kind == ShpShapeType::MultiPointM ||
+			shpHasZ(kind);
+	}
+
+	// Whether the value is one of the shape types in the spec
+	static constexpr bool shpIsShapeType(int32_t kind) noexcept
+	{
+		switch ((ShpShapeType)kind)
+		{
+		case ShpShapeType::NullShape:
+		case ShpShapeType::Point:
+		case ShpShapeType::PolyLine:
+		case ShpShapeType::Polygon:
+		case ShpShapeType::MultiPoint:
+		case ShpShapeType::PointZ:
+		case ShpShapeType::PolyLineZ:
+		case ShpShapeType::PolygonZ:
+		case ShpShapeType::MultiPointZ:
+		case ShpShapeType::PointM:
+		case ShpShapeType::PolyLineM:
+		case ShpShapeType::PolygonM:
+		case ShpShapeType::MultiPointM:
+		case ShpShapeType::MultiPatch:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// Shape types all fit in a byte, for compact storage.  Anything that
+	// isn't a shape type is stored as kShpInvalidType, rather than being
+	// cut down to a byte, where a corrupt 259 would turn into a PolyLine.
+	static constexpr uint8_t kShpInvalidType = 0xFF;
+
+	static constexpr uint8_t shpPackShapeType(int32_t kind) noexcept
+	{
+		return shpIsShapeType(kind) ? (uint8_t)kind : kShpInvalidType;
+	}
+
 }
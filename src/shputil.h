@@ -17,25 +17,28 @@ namespace waavs
 	//=======================================================
 	// Printing SVG appropriate to stdout
 	//=======================================================
-	static void printPoint(waavs::ByteSpan& bs)
+	// The shapes are decoded into the storage held by the context, 
+	// so printing a whole file of records does not allocate per record
+	static void printPoint(waavs::ByteSpan& bs, ShpDecodeContext& ctx = ShpDecodeContext::threadContext())
 	{
-		ShpPoint pt{};
-		if (!pt.readFromStream(bs))
+		const ShpPoint* pt = ctx.point(bs);
+		if (!pt)
 		{
 			printf("Failed to parse point\n");
 			return;
 		}
-		printf("<rect class='loc' x='%f' y='%f'  />\n", pt.numbers()[0], pt.numbers()[1]);
+		printf("<rect class='loc' x='%f' y='%f'  />\n", pt->numbers()[0], pt->numbers()[1]);
 	}
 	
-	static void printMultiPoint(waavs::ByteSpan& bs)
+	static void printMultiPoint(waavs::ByteSpan& bs, ShpDecodeContext& ctx = ShpDecodeContext::threadContext())
 	{
-		ShpMultiPoint mp{};
-		if (!mp.readFromStream(bs))
+		const ShpMultiPoint* mpp = ctx.multiPoint(bs);
+		if (!mpp)
 		{
 			printf("Failed to parse multi-point\n");
 			return;
 		}
+		const ShpMultiPoint& mp = *mpp;
 		
 		size_t numPoints = mp.numbers().size() / 2;
 		
@@ -47,14 +50,15 @@ namespace waavs
 	}
 
 	// Print a polygon as a svg path
-	static void printPolygon(waavs::ByteSpan& bs)
+	static void printPolygon(waavs::ByteSpan& bs, ShpDecodeContext& ctx = ShpDecodeContext::threadContext())
 	{
-		ShpPolygon poly{};
-		if (!poly.readFromStream(bs))
+		const ShpPolygon* polyp = ctx.polygon(bs);
+		if (!polyp)
 		{
 			printf("Failed to parse polygon\n");
 			return;
 		}
+		const ShpPolygon& poly = *polyp;
 		
 		size_t numParts = poly.parts().size();
 		size_t numPoints = poly.numbers().size() / 2;
@@ -78,14 +82,15 @@ namespace waavs
 		printf("\"/>\n");
 	}
 
-	static void printPolyLine(waavs::ByteSpan& bs)
+	static void printPolyLine(waavs::ByteSpan& bs, ShpDecodeContext& ctx = ShpDecodeContext::threadContext())
 	{
-		ShpPolyLine pl{};
-		if (!pl.readFromStream(bs))
+		const ShpPolyLine* plp = ctx.polyLine(bs);
+		if (!plp)
 		{
 			printf("Failed to parse polyline\n");
 			return;
 		}
+		const ShpPolyLine& pl = *plp;
 
 		size_t numParts = pl.parts().size();
 		size_t numPoints = pl.numbers().size() / 2;
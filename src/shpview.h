@@ -0,0 +1,438 @@
+#pragma once
+
+//
+// Zero-copy geometry views
+// 
+// ShpPolygon and friends copy every part index and coordinate into
+// std::vector<> storage.  The views here instead point straight at the
+// record content (typically in a MappedFile), and decode values as they
+// are accessed.  Parsing a view does no heap allocation at all, it 
+// just validates the counts, and captures where the arrays are.
+// 
+// Record content is only 2-byte aligned within the file, so the arrays
+// can not be handed out as plain 'const double *'.  ShpLEArray<> does
+// every load through as_f64_le()/memcpy, which is safe on unaligned data,
+// and byte swaps on a big-endian machine.
+// 
+// The owning classes in shpgeometry.h are still there for when the 
+// geometry needs to be changed.
+// 
+// The Z and M types are accepted by the view of their 2D counterpart, 
+// and their z() and m() arrays are filled in when present.
+// 
+// Usage:
+//	ShpPolygonView poly;
+//	ByteSpan rs(rec.content());
+//	if (poly.readFromStream(rs))
+//	{
+//		for (size_t i = 0; i < poly.numParts(); i++)
+//		{
+//			auto ring = poly.part(i);
+//			for (size_t j = 0; j < ring.size(); j++)
+//				draw(ring[j].x, ring[j].y);
+//		}
+//	}
+//
+
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+#include "bspan.h"
+#include "shptypes.h"
+#include "converters.h"
+#include "maths.h"
+
+
+namespace waavs {
+	// Load a single little-endian value of type T from possibly unaligned memory
+	template <typename T>
+	static INLINE T shp_load_le(const uint8_t* p) noexcept;
+
+	template <>
+	INLINE int32_t shp_load_le<int32_t>(const uint8_t* p) noexcept
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		if (isBE())
+			v = bswap32(v);
+		return (int32_t)v;
+	}
+
+	template <>
+	INLINE double shp_load_le<double>(const uint8_t* p) noexcept
+	{
+		return as_f64_le(p);
+	}
+
+	//
+	// ShpLEArray
+	// A read-only view of 'count' little-endian values of type T
+	//
+	template <typename T>
+	struct ShpLEArray
+	{
+		const uint8_t* fData{ nullptr };
+		size_t fCount{ 0 };
+
+		struct iterator
+		{
+			using iterator_category = std::input_iterator_tag;
+			using value_type = T;
+			using difference_type = std::ptrdiff_t;
+			using reference = T;
+
+			const uint8_t* fPtr{ nullptr };
+
+			T operator*() const { return shp_load_le<T>(fPtr); }
+			iterator& operator++() { fPtr += sizeof(T); return *this; }
+			iterator operator++(int) { iterator tmp = *this; fPtr += sizeof(T); return tmp; }
+			bool operator==(const iterator& other) const { return fPtr == other.fPtr; }
+		};
+
+		ShpLEArray() = default;
+		ShpLEArray(const uint8_t* data, size_t count) : fData(data), fCount(count) {}
+
+		size_t size() const { return fCount; }
+		bool empty() const { return fCount == 0; }
+		const uint8_t* data() const { return fData; }
+		size_t sizeInBytes() const { return fCount * sizeof(T); }
+
+		T operator[](size_t i) const { return shp_load_le<T>(fData + (i * sizeof(T))); }
+
+		ShpLEArray subArray(size_t first, size_t count) const { return { fData + (first * sizeof(T)), count }; }
+
+		iterator begin() const { return { fData }; }
+		iterator end() const { return { fData + (fCount * sizeof(T)) }; }
+	};
+
+	//
+	// ShpPointArray
+	// A read-only view of 'count' x/y pairs of little-endian doubles
+	//
+	struct ShpPointArray
+	{
+		const uint8_t* fData{ nullptr };
+		size_t fCount{ 0 };
+
+		ShpPointArray() = default;
+		ShpPointArray(const uint8_t* data, size_t count) : fData(data), fCount(count) {}
+
+		size_t size() const { return fCount; }
+		bool empty() const { return fCount == 0; }
+		const uint8_t* data() const { return fData; }
+		size_t sizeInBytes() const { return fCount * 16; }
+
+		double x(size_t i) const { return as_f64_le(fData + (i * 16)); }
+		double y(size_t i) const { return as_f64_le(fData + (i * 16) + 8); }
+		vec2d operator[](size_t i) const { return { x(i), y(i) }; }
+
+		ShpPointArray subArray(size_t first, size_t count) const { return { fData + (first * 16), count }; }
+	};
+
+
+	//
+	// ShpZMView
+	// The optional Z and M blocks that follow the x/y points of
+	// the Z and M shape types.  Each block is a [min, max] range, followed
+	// by one value per point.
+	//
+	struct ShpZMView
+	{
+		double zMin{ 0 };
+		double zMax{ 0 };
+		double mMin{ 0 };
+		double mMax{ 0 };
+		ShpLEArray<double> fZ{};
+		ShpLEArray<double> fM{};
+		bool fHasZ{ false };
+		bool fHasM{ false };
+
+		bool hasZ() const { return fHasZ; }
+		bool hasM() const { return fHasM; }
+		const ShpLEArray<double>& z() const { return fZ; }
+		const ShpLEArray<double>& m() const { return fM; }
+
+		// Capture the blocks that begin at 'p', with 'avail' bytes remaining
+		// The Z block is required for the Z types, the M block is 
+		// always optional.  Returns the number of bytes used, or -1
+		// if a required block is missing.
+		INLINE int64_t readBlocks(const uint8_t* p, size_t avail, ShpShapeType kind, size_t count)
+		{
+			fHasZ = fHasM = false;
+			fZ = {};
+			fM = {};
+
+			uint64_t blockSize = 16 + ((uint64_t)count * 8);
+			uint64_t used = 0;
+
+			if (shpHasZ(kind))
+			{
+				if (blockSize > avail)
+					return -1;
+
+				zMin = as_f64_le(p);
+				zMax = as_f64_le(p + 8);
+				fZ = ShpLEArray<double>(p + 16, count);
+				fHasZ = true;
+				used += blockSize;
+			}
+
+			if (shpHasM(kind) && (used + blockSize <= avail))
+			{
+				mMin = as_f64_le(p + used);
+				mMax = as_f64_le(p + used + 8);
+				fM = ShpLEArray<double>(p + used + 16, count);
+				fHasM = true;
+				used += blockSize;
+			}
+
+			return (int64_t)used;
+		}
+	};
+
+	//
+	// ShpPointView
+	//
+	struct ShpPointView
+	{
+		ShpShapeType fShapeType{ ShpShapeType::NullShape };
+		double x{ 0 };
+		double y{ 0 };
+		double z{ 0 };
+		double m{ 0 };
+		bool fHasZ{ false };
+		bool fHasM{ false };
+
+		ShpShapeType shapeType() const { return fShapeType; }
+		bool hasZ() const { return fHasZ; }
+		bool hasM() const { return fHasM; }
+
+		// Parse 'size' bytes of content at 'p', which is already known
+		// to be a point of type 'kind'.  Returns the number of bytes
+		// used, or -1 if the content is too small.
+		INLINE int64_t readContent(const uint8_t* p, size_t size, ShpShapeType kind)
+		{
+			// shape type, x, y, then z and m when the type has them
+			const size_t zSize = shpHasZ(kind) ? 8 : 0;
+			if (size < 20 + zSize)
+				return -1;
+
+			fShapeType = kind;
+			x = as_f64_le(p + 4);
+			y = as_f64_le(p + 12);
+			size_t used = 20;
+
+			fHasZ = fHasM = false;
+			if (shpHasZ(kind))
+			{
+				z = as_f64_le(p + used);
+				fHasZ = true;
+				used += 8;
+			}
+
+			if (shpHasM(kind) && size >= used + 8)
+			{
+				m = as_f64_le(p + used);
+				fHasM = true;
+				used += 8;
+			}
+
+			return (int64_t)used;
+		}
+
+		bool readFromStream(ByteSpan& bs)
+		{
+			if (bs.size() < 4)
+				return false;
+
+			ShpShapeType kind = (ShpShapeType)as_u32_le(bs.data());
+			if (shpBaseType(kind) != ShpShapeType::Point)
+				return false;
+
+			int64_t used = readContent(bs.data(), bs.size(), kind);
+			if (used < 0)
+				return false;
+
+			bs.skip((size_t)used);
+			return true;
+		}
+	};
+
+	//
+	// ShpMultiPartView
+	// Common to the PolyLine and Polygon views
+	//
+	struct ShpMultiPartView : public ShpZMView
+	{
+		ShpShapeType fShapeType{ ShpShapeType::NullShape };
+		double xMin{ 0 };
+		double yMin{ 0 };
+		double xMax{ 0 };
+		double yMax{ 0 };
+
+		ShpLEArray<int32_t> fParts{};
+		ShpPointArray fPoints{};
+
+		ShpShapeType shapeType() const { return fShapeType; }
+
+		const ShpLEArray<int32_t>& parts() const { return fParts; }
+		const ShpPointArray& points() const { return fPoints; }
+
+		size_t numParts() const { return fParts.size(); }
+		size_t numPoints() const { return fPoints.size(); }
+
+		// Index of the first point of the part, and one past its last
+		// These are safe to use, as readFromStream() has already checked
+		// the part indices are in order, and within the points.
+		size_t partStart(size_t i) const { return (size_t)fParts[i]; }
+		size_t partEnd(size_t i) const { return (i + 1 < numParts()) ? (size_t)fParts[i + 1] : numPoints(); }
+
+		// The points of a single part
+		ShpPointArray part(size_t i) const
+		{
+			size_t first = partStart(i);
+			return fPoints.subArray(first, partEnd(i) - first);
+		}
+
+		// Parse the header of a PolyLine or Polygon record (or the
+		// Z/M variants), and capture where the parts and points are.
+		// The whole record is checked for size once, here, so nothing
+		// needs to be checked while accessing the points.
+		// 'kind' is the record's shape type, already checked by the caller.
+		// Returns the number of bytes used, or -1 if the content is
+		// too small, or the part indices don't make sense.
+		INLINE int64_t readContent(const uint8_t* p, size_t size, ShpShapeType kind)
+		{
+			if (size < 44)
+				return -1;
+
+			fShapeType = kind;
+			xMin = as_f64_le(p + 4);
+			yMin = as_f64_le(p + 12);
+			xMax = as_f64_le(p + 20);
+			yMax = as_f64_le(p + 28);
+
+			int32_t numParts = shp_load_le<int32_t>(p + 36);
+			int32_t numPoints = shp_load_le<int32_t>(p + 40);
+			if (numParts < 0 || numPoints < 0)
+				return -1;
+
+			uint64_t needed = 44 + ((uint64_t)numParts * 4) + ((uint64_t)numPoints * 16);
+			if (needed > size)
+				return -1;
+
+			fParts = ShpLEArray<int32_t>(p + 44, (size_t)numParts);
+			fPoints = ShpPointArray(p + 44 + ((size_t)numParts * 4), (size_t)numPoints);
+
+			int64_t zmSize = readBlocks(p + needed, size - (size_t)needed, kind, (size_t)numPoints);
+			if (zmSize < 0)
+				return -1;
+
+			// part indices must be ascending, and refer to actual points
+			int32_t prev = 0;
+			for (size_t i = 0; i < fParts.size(); i++)
+			{
+				int32_t start = fParts[i];
+				if (start < prev || start > numPoints)
+					return -1;
+				prev = start;
+			}
+
+			return (int64_t)needed + zmSize;
+		}
+
+		bool readFromStream(ByteSpan& bs, ShpShapeType baseType)
+		{
+			if (bs.size() < 4)
+				return false;
+
+			ShpShapeType kind = (ShpShapeType)as_u32_le(bs.data());
+			if (shpBaseType(kind) != baseType)
+				return false;
+
+			int64_t used = readContent(bs.data(), bs.size(), kind);
+			if (used < 0)
+				return false;
+
+			bs.skip((size_t)used);
+			return true;
+		}
+	};
+
+	struct ShpPolyLineView : public ShpMultiPartView
+	{
+		bool readFromStream(ByteSpan& bs) { return ShpMultiPartView::readFromStream(bs, ShpShapeType::PolyLine); }
+	};
+
+	struct ShpPolygonView : public ShpMultiPartView
+	{
+		bool readFromStream(ByteSpan& bs) { return ShpMultiPartView::readFromStream(bs, ShpShapeType::Polygon); }
+	};
+
+	//
+	// ShpMultiPointView
+	//
+	struct ShpMultiPointView : public ShpZMView
+	{
+		ShpShapeType fShapeType{ ShpShapeType::NullShape };
+		double xMin{ 0 };
+		double yMin{ 0 };
+		double xMax{ 0 };
+		double yMax{ 0 };
+
+		ShpPointArray fPoints{};
+
+		ShpShapeType shapeType() const { return fShapeType; }
+		const ShpPointArray& points() const { return fPoints; }
+		size_t numPoints() const { return fPoints.size(); }
+
+		// Parse 'size' bytes of content at 'p', which is already known
+		// to be a multipoint of type 'kind'.  Returns the number of bytes
+		// used, or -1 if the content is too small.
+		INLINE int64_t readContent(const uint8_t* p, size_t size, ShpShapeType kind)
+		{
+			if (size < 40)
+				return -1;
+
+			fShapeType = kind;
+			xMin = as_f64_le(p + 4);
+			yMin = as_f64_le(p + 12);
+			xMax = as_f64_le(p + 20);
+			yMax = as_f64_le(p + 28);
+
+			int32_t numPoints = shp_load_le<int32_t>(p + 36);
+			if (numPoints < 0)
+				return -1;
+
+			uint64_t needed = 40 + ((uint64_t)numPoints * 16);
+			if (needed > size)
+				return -1;
+
+			fPoints = ShpPointArray(p + 40, (size_t)numPoints);
+
+			int64_t zmSize = readBlocks(p + needed, size - (size_t)needed, kind, (size_t)numPoints);
+			if (zmSize < 0)
+				return -1;
+
+			return (int64_t)needed + zmSize;
+		}
+
+		bool readFromStream(ByteSpan& bs)
+		{
+			if (bs.size() < 4)
+				return false;
+
+			ShpShapeType kind = (ShpShapeType)as_u32_le(bs.data());
+			if (shpBaseType(kind) != ShpShapeType::MultiPoint)
+				return false;
+
+			int64_t used = readContent(bs.data(), bs.size(), kind);
+			if (used < 0)
+				return false;
+
+			bs.skip((size_t)used);
+			return true;
+		}
+	};
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+//
+// visitShape
+//
+// Decode a record, and hand the geometry to a visitor, with a single
+// switch on the shape type.
+//
+// Each shape type has its own decoder, ShpShapeDecoder<Kind>, which
+// calls the view's readContent() with the shape type as a constant, so
+// there is only one parser for each record layout.  Once it's inlined,
+// the size of the fixed header, and whether there is a Z or M block,
+// are known at compile time.  The record is checked for size once, and
+// the visitor is called with a view over the content, in code that
+// is instantiated for that one shape type.  There are no virtual calls
+// between the record and the visitor, so the compiler is free to inline
+// the visitor's per-point work straight into the decode.
+//
+// A visitor is anything callable with the views it cares about.  Shape
+// types it can't take are skipped without being decoded at all.
+//
+//	ShpNullView				NullShape
+//	ShpPointView			Point, PointZ, PointM
+//	ShpPolyLineView			PolyLine, PolyLineZ, PolyLineM
+//	ShpPolygonView			Polygon, PolygonZ, PolygonM
+//	ShpMultiPointView		MultiPoint, MultiPointZ, MultiPointM
+//	ShpMultiPatch			MultiPatch
+//
+// ShpPolyLineView and ShpPolygonView are both a ShpMultiPartView, so one
+// overload can take both.  If the visitor also takes a ShpShapeTag<Kind>
+// as a second parameter, the exact shape type is available as a constant.
+//
+// Usage:
+//	struct Counter {
+//		size_t points = 0;
+//		void operator()(const ShpMultiPartView& v) { points += v.numPoints(); }
+//		void operator()(const ShpPointView&) { points++; }
+//	};
+//
+//	Counter c;
+//	for (const ShpRecord& rec : shp.records())
+//		visitShape(rec, c);
+//
+
+#include <cstdint>
+#include <type_traits>
+
+#include "bspan.h"
+#include "shptypes.h"
+#include "shapefile.h"
+#include "shpview.h"
+#include "shpmultipatch.h"
+
+
+namespace waavs {
+	// The shape type, as a compile time constant
+	template <ShpShapeType Kind>
+	struct ShpShapeTag
+	{
+		static constexpr ShpShapeType kind = Kind;
+	};
+
+	struct ShpNullView
+	{
+		ShpShapeType shapeType() const { return ShpShapeType::NullShape; }
+	};
+
+	//
+	// ShpShapeDecoder
+	// One decoder per shape type.  The content has already been checked
+	// to start with 'Kind', so it's not looked at again.
+	//
+	template <ShpShapeType Kind, ShpShapeType Base = shpBaseType(Kind)>
+	struct ShpShapeDecoder;
+
+	template <ShpShapeType Kind>
+	struct ShpShapeDecoder<Kind, ShpShapeType::NullShape>
+	{
+		using view_type = ShpNullView;
+
+		static INLINE bool read(const uint8_t*, size_t, view_type&) noexcept { return true; }
+	};
+
+	template <ShpShapeType Kind>
+	struct ShpShapeDecoder<Kind, ShpShapeType::Point>
+	{
+		using view_type = ShpPointView;
+
+		static INLINE bool read(const uint8_t* p, size_t size, view_type& v) noexcept { return v.readContent(p, size, Kind) >= 0; }
+	};
+
+	template <ShpShapeType Kind>
+	struct ShpShapeDecoder<Kind, ShpShapeType::PolyLine>
+	{
+		using view_type = ShpPolyLineView;
+
+		static INLINE bool read(const uint8_t* p, size_t size, view_type& v) noexcept { return v.readContent(p, size, Kind) >= 0; }
+	};
+
+	template <ShpShapeType Kind>
+	struct ShpShapeDecoder<Kind, ShpShapeType::Polygon>
+	{
+		using view_type = ShpPolygonView;
+
+		static INLINE bool read(const uint8_t* p, size_t size, view_type& v) noexcept { return v.readContent(p, size, Kind) >= 0; }
+	};
+
+	template <ShpShapeType Kind>
+	struct ShpShapeDecoder<Kind, ShpShapeType::MultiPoint>
+	{
+		using view_type = ShpMultiPointView;
+
+		static INLINE bool read(const uint8_t* p, size_t size, view_type& v) noexcept { return v.readContent(p, size, Kind) >= 0; }
+	};
+
+	// Call the visitor with the view, if it takes it
+	template <ShpShapeType Kind, typename View, typename Visitor>
+	static constexpr bool shpVisitorTakes() noexcept
+	{
+		return std::is_invocable_v<Visitor&, const View&, ShpShapeTag<Kind>> ||
+			std::is_invocable_v<Visitor&, const View&>;
+	}
+
+	template <ShpShapeType Kind, typename View, typename Visitor>
+	static INLINE void shpInvokeVisitor(Visitor& vis, const View& v)
+	{
+		if constexpr (std::is_invocable_v<Visitor&, const View&, ShpShapeTag<Kind>>)
+			vis(v, ShpShapeTag<Kind>{});
+		else
+			vis(v);
+	}
+
+	// Decode the content as exactly 'Kind', and visit it
+	template <ShpShapeType Kind, typename Visitor>
+	static INLINE bool visitShapeAs(const ByteSpan& content, Visitor& vis)
+	{
+		using Decoder = ShpShapeDecoder<Kind>;
+		using View = typename Decoder::view_type;
+
+		// Nothing to do, so don't bother decoding
+		if constexpr (!shpVisitorTakes<Kind, View, Visitor>())
+		{
+			return true;
+		}
+		else {
+			View v{};
+			if (!Decoder::read(content.data(), content.size(), v))
+				return false;
+
+			shpInvokeVisitor<Kind>(vis, v);
+			return true;
+		}
+	}
+
+	// MultiPatch records are triangulated, so they're decoded into
+	// storage that's kept per thread, and reused
+	template <typename Visitor>
+	static INLINE bool visitMultiPatch(const ByteSpan& content, Visitor& vis)
+	{
+		if constexpr (!shpVisitorTakes<ShpShapeType::MultiPatch, ShpMultiPatch, Visitor>())
+		{
+			return true;
+		}
+		else {
+			static thread_local ShpMultiPatch mesh{};
+
+			ByteSpan bs(content);
+			if (!mesh.readFromStream(bs))
+				return false;
+
+			shpInvokeVisitor<ShpShapeType::MultiPatch>(vis, mesh);
+			return true;
+		}
+	}
+
+	// Visit the geometry in a record's content
+	// Returns false if the shape type is unknown, or the content
+	// is not big enough to hold what it says it holds.
+	template <typename Visitor>
+	static bool visitShape(const ByteSpan& content, Visitor&& vis)
+	{
+		if (content.size() < 4)
+			return false;
+
+		switch ((ShpShapeType)as_u32_le(content.data()))
+		{
+		case ShpShapeType::NullShape:		return visitShapeAs<ShpShapeType::NullShape>(content, vis);
+		case ShpShapeType::Point:			return visitShapeAs<ShpShapeType::Point>(content, vis);
+		case ShpShapeType::PolyLine:		return visitShapeAs<ShpShapeType::PolyLine>(content, vis);
+		case ShpShapeType::Polygon:			return visitShapeAs<ShpShapeType::Polygon>(content, vis);
+		case ShpShapeType::MultiPoint:		return visitShapeAs<ShpShapeType::MultiPoint>(content, vis);
+		case ShpShapeType::PointZ:			return visitShapeAs<ShpShapeType::PointZ>(content, vis);
+		case ShpShapeType::PolyLineZ:		return visitShapeAs<ShpShapeType::PolyLineZ>(content, vis);
+		case ShpShapeType::PolygonZ:		return visitShapeAs<ShpShapeType::PolygonZ>(content, vis);
+		case ShpShapeType::MultiPointZ:		return visitShapeAs<ShpShapeType::MultiPointZ>(content, vis);
+		case ShpShapeType::PointM:			return visitShapeAs<ShpShapeType::PointM>(content, vis);
+		case ShpShapeType::PolyLineM:		return visitShapeAs<ShpShapeType::PolyLineM>(content, vis);
+		case ShpShapeType::PolygonM:		return visitShapeAs<ShpShapeType::PolygonM>(content, vis);
+		case ShpShapeType::MultiPointM:		return visitShapeAs<ShpShapeType::MultiPointM>(content, vis);
+		case ShpShapeType::MultiPatch:		return visitMultiPatch(content, vis);
+		default:
+			return false;
+		}
+	}
+
+	template <typename Visitor>
+	static INLINE bool visitShape(const ShpRecord& rec, Visitor&& vis)
+	{
+		return visitShape(rec.content(), vis);
+	}
+}
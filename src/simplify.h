@@ -0,0 +1,455 @@
+#pragma once
+
+//
+// Line simplification
+//
+// Drop the vertices of a line, or ring, that don't change its shape by
+// more than some tolerance.  When a map is drawn small, most of the
+// vertices of a detailed layer land in the same pixel as their
+// neighbours, and only add to the size of the output.
+//
+//	simplifyDouglasPeucker()	keeps the vertices that are further than the
+//								tolerance from the line through the ones kept
+//								around them (Douglas & Peucker, 1973)
+//	simplifyVisvalingam()		repeatedly drops the vertex that makes the
+//								smallest triangle with its neighbours, until
+//								none is smaller than half a tolerance squared
+//								(Visvalingam & Whyatt, 1993)
+//
+// Douglas-Peucker bounds how far the line can move.  Visvalingam bounds
+// the area each dropped vertex takes away, which keeps more of the
+// character of a coastline, but long thin spikes can go.
+//
+// Both mark the vertices to keep, in keep[], and never go below the
+// minimum a line (2 vertices) or a ring (4, three corners and the
+// closing vertex) needs.  The first and last vertex are always kept, so
+// a ring stays closed.
+//
+// The tolerance is in whatever units the coordinates are in.  To have it
+// in output pixels, simplify after projecting, with the tolerance in
+// pixels times the output units per pixel.
+//
+// simplifySnapToGrid() is the cheap alternative, in a single pass.  It
+// moves each vertex to the nearest point of an output grid, such as the
+// pixels, and drops the ones that land where the one before did.  Rings
+// and lines that fit inside a grid cell can be left out altogether,
+// simplifyExtentBelow() is the test for that.
+//
+// PathSimplifier is the streaming form, for an export.  The points of a
+// ring are added as they come out of the projection, then simplified
+// in one go, and the kept ones read back.  Its buffers are reused from
+// ring to ring, so it doesn't allocate once it's grown to the size of
+// the largest ring.
+//
+// Usage:
+//	PathSimplifier simp(SimplifyMethod::DouglasPeucker, 0.5 * unitsPerPixel);
+//	simp.reset();
+//	simp.add(xs, ys, n);
+//	size_t kept = simp.simplify(true);
+//	emit(simp.x(), simp.y(), kept);
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "definitions.h"
+
+
+namespace waavs {
+	enum class SimplifyMethod
+	{
+		None,
+		DouglasPeucker,
+		Visvalingam,
+	};
+
+	// The fewest vertices a line, or a closed ring, can have
+	static INLINE size_t simplifyMinPoints(bool closed) noexcept
+	{
+		return closed ? 4 : 2;
+	}
+
+	// Squared distance from p to the segment a-b
+	static INLINE double simplifySegmentDistance2(double px, double py, double ax, double ay, double bx, double by) noexcept
+	{
+		double dx = bx - ax;
+		double dy = by - ay;
+		double len2 = (dx * dx) + (dy * dy);
+		double t = 0;
+		if (len2 > 0)
+		{
+			t = (((px - ax) * dx) + ((py - ay) * dy)) / len2;
+			t = t < 0 ? 0 : (t > 1 ? 1 : t);
+		}
+
+		double ex = px - (ax + (t * dx));
+		double ey = py - (ay + (t * dy));
+		return (ex * ex) + (ey * ey);
+	}
+
+	//
+	// Douglas-Peucker
+	// Done with an explicit stack of spans, so a long line doesn't
+	// recurse deeply.  'stack' is scratch space, passed in so it can be reused.
+	//
+	static size_t simplifyDouglasPeucker(const double* xs, const double* ys, size_t n, double tolerance, bool closed,
+		uint8_t* keep, std::vector<size_t>& stack)
+	{
+		for (size_t i = 0; i < n; i++)
+			keep[i] = 0;
+
+		if (n <= simplifyMinPoints(closed))
+		{
+			for (size_t i = 0; i < n; i++)
+				keep[i] = 1;
+			return n;
+		}
+
+		keep[0] = 1;
+		keep[n - 1] = 1;
+		size_t kept = 2;
+
+		// A ring starts and ends on the same vertex, so there's no line to
+		// measure from.  Split it at the vertex furthest from the start,
+		// and do each half.
+		stack.clear();
+		if (closed)
+		{
+			size_t far = 0;
+			double farD = -1;
+			for (size_t i = 1; i < n - 1; i++)
+			{
+				double dx = xs[i] - xs[0];
+				double dy = ys[i] - ys[0];
+				double d = (dx * dx) + (dy * dy);
+				if (d > farD)
+				{
+					farD = d;
+					far = i;
+				}
+			}
+			keep[far] = 1;
+			kept++;
+			stack.push_back(0);
+			stack.push_back(far);
+			stack.push_back(far);
+			stack.push_back(n - 1);
+		}
+		else {
+			stack.push_back(0);
+			stack.push_back(n - 1);
+		}
+
+		double tol2 = tolerance * tolerance;
+		while (!stack.empty())
+		{
+			size_t last = stack.back();
+			stack.pop_back();
+			size_t first = stack.back();
+			stack.pop_back();
+
+			size_t worst = 0;
+			double worstD = -1;
+			for (size_t i = first + 1; i < last; i++)
+			{
+				double d = simplifySegmentDistance2(xs[i], ys[i], xs[first], ys[first], xs[last], ys[last]);
+				if (d > worstD)
+				{
+					worstD = d;
+					worst = i;
+				}
+			}
+
+			if (worstD > tol2)
+			{
+				keep[worst] = 1;
+				kept++;
+				stack.push_back(first);
+				stack.push_back(worst);
+				stack.push_back(worst);
+				stack.push_back(last);
+			}
+		}
+
+		// Too few left for a ring, put back the vertices furthest from
+		// what's there until there are enough
+		while (kept < simplifyMinPoints(closed))
+		{
+			size_t best = 0;
+			double bestD = -1;
+			size_t prev = 0;
+			for (size_t i = 1; i < n; i++)
+			{
+				if (keep[i])
+				{
+					prev = i;
+					continue;
+				}
+
+				size_t next = i + 1;
+				while (!keep[next])
+					next++;
+
+				double d = simplifySegmentDistance2(xs[i], ys[i], xs[prev], ys[prev], xs[next], ys[next]);
+				if (d > bestD)
+				{
+					bestD = d;
+					best = i;
+				}
+			}
+			if (bestD < 0)
+				break;
+
+			keep[best] = 1;
+			kept++;
+		}
+
+		return kept;
+	}
+
+	//
+	// Visvalingam-Whyatt
+	// The vertices are a linked list, and their triangle areas a heap.
+	// Entries in the heap that are out of date, because a neighbour was
+	// removed since, are skipped when they come to the top.
+	//
+	struct SimplifyVWScratch
+	{
+		struct Entry
+		{
+			double area;
+			size_t index;
+			uint32_t version;
+
+			bool operator<(const Entry& other) const { return area > other.area; }
+		};
+
+		std::vector<size_t> prev{};
+		std::vector<size_t> next{};
+		std::vector<uint32_t> version{};
+		std::vector<Entry> heap{};
+	};
+
+	static INLINE double simplifyTriangleArea(const double* xs, const double* ys, size_t a, size_t b, size_t c) noexcept
+	{
+		double area = ((xs[b] - xs[a]) * (ys[c] - ys[a])) - ((xs[c] - xs[a]) * (ys[b] - ys[a]));
+		return (area < 0 ? -area : area) * 0.5;
+	}
+
+	static size_t simplifyVisvalingam(const double* xs, const double* ys, size_t n, double tolerance, bool closed,
+		uint8_t* keep, SimplifyVWScratch& scratch)
+	{
+		for (size_t i = 0; i < n; i++)
+			keep[i] = 1;
+
+		size_t minPoints = simplifyMinPoints(closed);
+		if (n <= minPoints)
+			return n;
+
+		scratch.prev.resize(n);
+		scratch.next.resize(n);
+		scratch.version.assign(n, 0);
+
+		// a min heap, on area
+		std::vector<SimplifyVWScratch::Entry>& heap = scratch.heap;
+		heap.clear();
+
+		for (size_t i = 0; i < n; i++)
+		{
+			scratch.prev[i] = i - 1;
+			scratch.next[i] = i + 1;
+		}
+		for (size_t i = 1; i < n - 1; i++)
+			heap.push_back({ simplifyTriangleArea(xs, ys, i - 1, i, i + 1), i, 0 });
+		std::make_heap(heap.begin(), heap.end());
+
+		double threshold = 0.5 * tolerance * tolerance;
+		size_t kept = n;
+		double lastArea = 0;
+		while (!heap.empty() && kept > minPoints)
+		{
+			SimplifyVWScratch::Entry e = heap.front();
+			std::pop_heap(heap.begin(), heap.end());
+			heap.pop_back();
+			if (e.version != scratch.version[e.index])
+				continue;
+
+			// an area can't be less than one removed before it, or a
+			// vertex would go only because its neighbour did
+			double area = e.area < lastArea ? lastArea : e.area;
+			if (area >= threshold)
+				break;
+			lastArea = area;
+
+			size_t i = e.index;
+			size_t p = scratch.prev[i];
+			size_t q = scratch.next[i];
+			keep[i] = 0;
+			kept--;
+			scratch.next[p] = q;
+			scratch.prev[q] = p;
+
+			// the neighbours have new triangles
+			if (p > 0)
+			{
+				scratch.version[p]++;
+				heap.push_back({ simplifyTriangleArea(xs, ys, scratch.prev[p], p, q), p, scratch.version[p] });
+				std::push_heap(heap.begin(), heap.end());
+			}
+			if (q < n - 1)
+			{
+				scratch.version[q]++;
+				heap.push_back({ simplifyTriangleArea(xs, ys, p, q, scratch.next[q]), q, scratch.version[q] });
+				std::push_heap(heap.begin(), heap.end());
+			}
+		}
+
+		return kept;
+	}
+
+	//
+	// Grid snapping
+	//
+
+	// Snap the points, in place, to the grid of 'cell' sized squares that
+	// has a corner at the origin, and drop each one that lands on the
+	// same grid point as the one before.  Returns how many are left.
+	static size_t simplifySnapToGrid(double* xs, double* ys, size_t n, double cell, double originX, double originY) noexcept
+	{
+		if (n == 0 || !(cell > 0))
+			return n;
+
+		double inv = 1.0 / cell;
+		size_t out = 0;
+		double lastX = 0;
+		double lastY = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			double x = originX + (std::round((xs[i] - originX) * inv) * cell);
+			double y = originY + (std::round((ys[i] - originY) * inv) * cell);
+			if (out > 0 && x == lastX && y == lastY)
+				continue;
+
+			xs[out] = lastX = x;
+			ys[out] = lastY = y;
+			out++;
+		}
+
+		return out;
+	}
+
+	// Whether the points fit within a size x size square, so they'd
+	// be drawn within a single pixel
+	static bool simplifyExtentBelow(const double* xs, const double* ys, size_t n, double size) noexcept
+	{
+		if (n == 0)
+			return true;
+
+		double minX = xs[0], maxX = xs[0];
+		double minY = ys[0], maxY = ys[0];
+		for (size_t i = 1; i < n; i++)
+		{
+			minX = xs[i] < minX ? xs[i] : minX;
+			maxX = xs[i] > maxX ? xs[i] : maxX;
+			minY = ys[i] < minY ? ys[i] : minY;
+			maxY = ys[i] > maxY ? ys[i] : maxY;
+		}
+
+		return (maxX - minX) < size && (maxY - minY) < size;
+	}
+
+	//
+	// PathSimplifier
+	// The streaming stage, one ring at a time
+	//
+	struct PathSimplifier
+	{
+		SimplifyMethod fMethod{ SimplifyMethod::None };
+		double fTolerance{ 0 };
+
+		std::vector<double> fX{};
+		std::vector<double> fY{};
+		std::vector<uint8_t> fKeep{};
+		std::vector<size_t> fStack{};
+		SimplifyVWScratch fScratch{};
+		size_t fCount{ 0 };
+
+		PathSimplifier() = default;
+		PathSimplifier(SimplifyMethod method, double tolerance) : fMethod(method), fTolerance(tolerance) {}
+
+		SimplifyMethod method() const { return fMethod; }
+		double tolerance() const { return fTolerance; }
+		void setMethod(SimplifyMethod method, double tolerance)
+		{
+			fMethod = method;
+			fTolerance = tolerance;
+		}
+
+		// The points, after simplify()
+		const double* x() const { return fX.data(); }
+		const double* y() const { return fY.data(); }
+		size_t size() const { return fCount; }
+
+		// Start a new ring
+		void reset()
+		{
+			fX.clear();
+			fY.clear();
+			fCount = 0;
+		}
+
+		void add(const double* xs, const double* ys, size_t count)
+		{
+			fX.insert(fX.end(), xs, xs + count);
+			fY.insert(fY.end(), ys, ys + count);
+			fCount = fX.size();
+		}
+
+		// Simplify what's been added, leaving the kept points, in
+		// order, in x() and y().  Returns how many there are.
+		size_t simplify(bool closed)
+		{
+			size_t n = fX.size();
+			if (fMethod == SimplifyMethod::None || n <= simplifyMinPoints(closed))
+			{
+				fCount = n;
+				return fCount;
+			}
+
+			fKeep.resize(n);
+			if (fMethod == SimplifyMethod::DouglasPeucker)
+				simplifyDouglasPeucker(fX.data(), fY.data(), n, fTolerance, closed, fKeep.data(), fStack);
+			else
+				simplifyVisvalingam(fX.data(), fY.data(), n, fTolerance, closed, fKeep.data(), fScratch);
+
+			// squeeze the kept ones down, in place
+			size_t out = 0;
+			for (size_t i = 0; i < n; i++)
+			{
+				if (fKeep[i])
+				{
+					fX[out] = fX[i];
+					fY[out] = fY[i];
+					out++;
+				}
+			}
+			fCount = out;
+			return fCount;
+		}
+
+		// Snap what's left to a grid, dropping repeats, see simplifySnapToGrid()
+		size_t snap(double cell, double originX, double originY)
+		{
+			fCount = simplifySnapToGrid(fX.data(), fY.data(), fCount, cell, originX, originY);
+			return fCount;
+		}
+
+		bool extentBelow(double size) const
+		{
+			return simplifyExtentBelow(fX.data(), fY.data(), fCount, size);
+		}
+	};
+}
@@ -0,0 +1,454 @@
+#pragma once
+
+//
+// SvgWriter
+//
+// Buffered output, for writing a lot of svg quickly.
+//
+// printf() goes through the C library's locale aware formatting, and
+// stdio's locking and buffering, for every number.  An svg of a map is
+// mostly numbers, so that's where all the time goes.
+//
+// SvgWriter formats numbers with std::to_chars(), which doesn't look
+// at the locale, and is exact, into a large buffer that it owns.  When
+// the buffer is full, it's handed to write() on the file descriptor in
+// one go, bypassing stdio altogether.
+//
+// Numbers are written with a fixed number of decimal places, which
+// gives the same text as printf("%.4f") does for a precision of 4, or
+// with kShortest, the fewest digits that read back as the same double.
+//
+// Since it bypasses stdio, don't mix printf() to the same descriptor
+// without a fflush() before using the writer.
+//
+// A writer made with kMemory, instead of a file descriptor, never
+// flushes, the buffer just grows.  That's for putting a piece of the
+// output together on one thread, to be written out by another.
+//
+// SvgPathEncoder writes path data compactly, with relative l/h/v
+// commands, and only the separators the path grammar needs.
+//
+// Usage:
+//	SvgWriter out(1);		// stdout
+//	out.write("<path d=\"M");
+//	out.points(xs, ys, n);
+//	out.write("\"/>\n");
+//
+
+#include <charconv>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+#include "definitions.h"
+
+
+namespace waavs {
+	// Write all of the bytes to the file descriptor
+	static bool svgWriteFd(int fd, const char* data, size_t size)
+	{
+		while (size > 0)
+		{
+#ifdef _WIN32
+			unsigned int chunk = size > 0x40000000 ? 0x40000000 : (unsigned int)size;
+			int written = _write(fd, data, chunk);
+			if (written <= 0)
+				return false;
+#else
+			ssize_t written = ::write(fd, data, size);
+			if (written < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+#endif
+			data += written;
+			size -= (size_t)written;
+		}
+
+		return true;
+	}
+
+	struct SvgWriter
+	{
+		static constexpr size_t kDefaultCapacity = 1024 * 1024;
+		static constexpr int kShortest = -1;
+		static constexpr int kMemory = -1;			// no file descriptor, keep it all
+
+		// Enough for any double, in fixed notation, with the
+		// largest precision allowed
+		static constexpr int kMaxPrecision = 17;
+		static constexpr size_t kMaxNumberChars = 310 + kMaxPrecision + 2;
+
+		int fFd{ -1 };
+		std::vector<char> fBuffer{};
+		size_t fUsed{ 0 };
+		int fPrecision{ 4 };
+		bool fFailed{ false };
+
+		explicit SvgWriter(int fd = 1, size_t capacity = kDefaultCapacity)
+			: fFd(fd)
+		{
+			fBuffer.resize(capacity < kMaxNumberChars * 4 ? kMaxNumberChars * 4 : capacity);
+		}
+
+		~SvgWriter()
+		{
+			flush();
+		}
+
+		SvgWriter(const SvgWriter&) = delete;
+		SvgWriter& operator=(const SvgWriter&) = delete;
+
+		int fd() const { return fFd; }
+		bool isMemory() const { return fFd < 0; }
+		bool failed() const { return fFailed; }
+		size_t pending() const { return fUsed; }
+
+		// What's been written, and not yet flushed
+		const char* data() const { return fBuffer.data(); }
+
+		// Throw away what's in the buffer, keeping the space
+		void clear() { fUsed = 0; }
+
+		// Decimal places for numbers, or kShortest
+		int precision() const { return fPrecision; }
+		void setPrecision(int digits)
+		{
+			fPrecision = digits < 0 ? kShortest : (digits > kMaxPrecision ? kMaxPrecision : digits);
+		}
+
+		// Send what's in the buffer to the file descriptor
+		// A memory writer keeps what it has
+		bool flush()
+		{
+			if (isMemory())
+				return true;
+
+			if (fUsed > 0 && !fFailed)
+				fFailed = !svgWriteFd(fFd, fBuffer.data(), fUsed);
+			fUsed = 0;
+
+			return !fFailed;
+		}
+
+		// Room for at least n more bytes, at the returned pointer
+		INLINE char* reserve(size_t n)
+		{
+			if (fUsed + n > fBuffer.size())
+			{
+				if (isMemory())
+					fBuffer.resize((fUsed + n) > (fBuffer.size() * 2) ? (fUsed + n) : (fBuffer.size() * 2));
+				else
+					flush();
+			}
+			return fBuffer.data() + fUsed;
+		}
+
+		// Mark the bytes up to 'end' as written, after a reserve()
+		INLINE void commit(char* end)
+		{
+			fUsed = (size_t)(end - fBuffer.data());
+		}
+
+		void write(const char* data, size_t size)
+		{
+			// Big enough that copying isn't worth it
+			if (size >= fBuffer.size() && !isMemory())
+			{
+				flush();
+				if (!fFailed)
+					fFailed = !svgWriteFd(fFd, data, size);
+				return;
+			}
+
+			char* p = reserve(size);
+			memcpy(p, data, size);
+			fUsed += size;
+		}
+
+		void write(const char* str) { write(str, strlen(str)); }
+
+		INLINE void put(char c)
+		{
+			char* p = reserve(1);
+			*p = c;
+			fUsed++;
+		}
+
+		// Format a number straight into the buffer
+		INLINE char* formatNumber(char* p, double value) const
+		{
+			std::to_chars_result res = (fPrecision == kShortest) ?
+				std::to_chars(p, p + kMaxNumberChars, value) :
+				std::to_chars(p, p + kMaxNumberChars, value, std::chars_format::fixed, fPrecision);
+
+			return res.ptr;
+		}
+
+		INLINE void number(double value)
+		{
+			commit(formatNumber(reserve(kMaxNumberChars), value));
+		}
+
+		// Coordinate pairs, as " x, y" for each point
+		void points(const double* xs, const double* ys, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				char* p = reserve((kMaxNumberChars * 2) + 3);
+				*p++ = ' ';
+				p = formatNumber(p, xs[i]);
+				*p++ = ',';
+				*p++ = ' ';
+				p = formatNumber(p, ys[i]);
+				commit(p);
+			}
+		}
+
+		// printf() style, for the odd bit of text that isn't worth
+		// putting together by hand
+		void format(const char* fmt, ...)
+		{
+			char local[512];
+
+			va_list args;
+			va_start(args, fmt);
+			int len = vsnprintf(local, sizeof(local), fmt, args);
+			va_end(args);
+
+			if (len < 0)
+				return;
+
+			if ((size_t)len < sizeof(local))
+			{
+				write(local, (size_t)len);
+				return;
+			}
+
+			std::vector<char> big((size_t)len + 1);
+			va_start(args, fmt);
+			vsnprintf(big.data(), big.size(), fmt, args);
+			va_end(args);
+			write(big.data(), (size_t)len);
+		}
+	};
+
+	//
+	// SvgPathEncoder
+	//
+	// Path data, as small as it can be written.  Every position is
+	// rounded to a grid of 10^-digits, and each segment is written as the
+	// difference from the previous position, in whole steps of that grid.
+	// Since the positions are rounded, and not the differences, the error
+	// never builds up along a path, every point is within half a step of
+	// where it should be.
+	//
+	//	- a segment is 'l dx dy', or 'h dx' / 'v dy' when one is zero
+	//	- segments that don't move at all are left out
+	//	- a repeated command doesn't repeat its letter
+	//	- numbers drop trailing zeros, and a leading zero ("-.5")
+	//	- there's no separator before a '-', or before a '.' when the
+	//	  number before already has one ("1.5.5" is 1.5 then .5)
+	//	- the segment that closes a ring back on its start is left to 'z'
+	//
+	// The first subpath starts with an absolute 'M', later ones with a
+	// relative 'm'.
+	//
+	// Usage:
+	//	SvgPathEncoder enc(out, 1);
+	//	enc.moveTo(x[0], y[0]);
+	//	enc.lineTo(&x[1], &y[1], n - 1);
+	//	enc.close();
+	//
+	struct SvgPathEncoder
+	{
+		static constexpr int kMaxDigits = 9;
+
+		SvgWriter& fOut;
+		int fDigits{ 1 };
+		double fScale{ 10 };
+
+		int64_t fX{ 0 };			// current position, in steps
+		int64_t fY{ 0 };
+		int64_t fStartX{ 0 };		// where the subpath started
+		int64_t fStartY{ 0 };
+		bool fStarted{ false };
+
+		// the last segment, held back in case it's the one that closes the ring
+		int64_t fPendingX{ 0 };
+		int64_t fPendingY{ 0 };
+		bool fHasPending{ false };
+
+		char fCommand{ 0 };			// last command written
+		bool fAfterNumber{ false };	// the last thing written was a number
+		bool fNumberHasDot{ false };	// and it had a '.'
+
+		SvgPathEncoder(SvgWriter& out, int digits)
+			: fOut(out)
+		{
+			fDigits = digits < 0 ? 0 : (digits > kMaxDigits ? kMaxDigits : digits);
+			fScale = std::pow(10.0, fDigits);
+		}
+
+		~SvgPathEncoder()
+		{
+			flushPending();
+		}
+
+		INLINE int64_t quantize(double v) const
+		{
+			return (int64_t)std::llround(v * fScale);
+		}
+
+		void command(char c)
+		{
+			if (c == fCommand && c != 'z')
+				return;
+
+			fOut.put(c);
+			fCommand = c;
+			fAfterNumber = false;
+		}
+
+		// A number of steps, written as a decimal
+		void number(int64_t steps)
+		{
+			// the magnitude, with at least one digit before the decimal places
+			char digits[32];
+			uint64_t mag = steps < 0 ? (uint64_t)0 - (uint64_t)steps : (uint64_t)steps;
+			char* end = std::to_chars(digits + kMaxDigits, digits + sizeof(digits), mag).ptr;
+			char* start = digits + kMaxDigits;
+			while (end - start < fDigits + 1)
+				*--start = '0';
+
+			char* point = end - fDigits;
+			char* fracEnd = end;
+			while (fracEnd > point && fracEnd[-1] == '0')
+				fracEnd--;
+			bool hasFraction = fracEnd > point;
+
+			// a whole part of 0 isn't needed before a fraction
+			if (hasFraction && point - start == 1 && *start == '0')
+				start++;
+
+			char lead = steps < 0 ? '-' : (start == point ? '.' : *start);
+			char* p = fOut.reserve(48);
+			if (fAfterNumber && lead != '-' && !(lead == '.' && fNumberHasDot))
+				*p++ = ' ';
+			if (steps < 0)
+				*p++ = '-';
+
+			memcpy(p, start, (size_t)(point - start));
+			p += point - start;
+			if (hasFraction)
+			{
+				*p++ = '.';
+				memcpy(p, point, (size_t)(fracEnd - point));
+				p += fracEnd - point;
+			}
+			fOut.commit(p);
+
+			fAfterNumber = true;
+			fNumberHasDot = hasFraction;
+		}
+
+		void segment(int64_t dx, int64_t dy)
+		{
+			if (dy == 0)
+			{
+				command('h');
+				number(dx);
+			}
+			else if (dx == 0) {
+				command('v');
+				number(dy);
+			}
+			else {
+				command('l');
+				number(dx);
+				number(dy);
+			}
+		}
+
+		void flushPending()
+		{
+			if (!fHasPending)
+				return;
+
+			segment(fPendingX, fPendingY);
+			fHasPending = false;
+		}
+
+		void moveTo(double x, double y)
+		{
+			flushPending();
+
+			int64_t qx = quantize(x);
+			int64_t qy = quantize(y);
+			if (!fStarted)
+			{
+				command('M');
+				number(qx);
+				number(qy);
+				fStarted = true;
+			}
+			else {
+				command('m');
+				number(qx - fX);
+				number(qy - fY);
+			}
+
+			// pairs following an 'm' are taken as 'l', but after
+			// an 'M' they'd be 'L'
+			fCommand = (fCommand == 'm') ? 'l' : 'M';
+			fX = fStartX = qx;
+			fY = fStartY = qy;
+		}
+
+		void lineTo(double x, double y)
+		{
+			int64_t qx = quantize(x);
+			int64_t qy = quantize(y);
+			if (qx == fX && qy == fY)
+				return;
+
+			flushPending();
+			fPendingX = qx - fX;
+			fPendingY = qy - fY;
+			fHasPending = true;
+			fX = qx;
+			fY = qy;
+		}
+
+		void lineTo(const double* xs, const double* ys, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+				lineTo(xs[i], ys[i]);
+		}
+
+		// Close the subpath, which takes the position back to its start
+		void close()
+		{
+			// 'z' draws the closing segment anyway
+			if (fHasPending && fX == fStartX && fY == fStartY)
+				fHasPending = false;
+			flushPending();
+
+			command('z');
+			fX = fStartX;
+			fY = fStartY;
+		}
+	};
+}
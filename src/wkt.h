@@ -0,0 +1,221 @@
+#pragma once
+
+//
+// WKT (Well Known Text) parsing
+//
+// A .prj file holds a coordinate system as WKT, like this
+//	GEOGCS["GCS_North_American_1983",
+//		DATUM["D_North_American_1983",SPHEROID["GRS_1980",6378137,298.257222101]],
+//		PRIMEM["Greenwich",0],
+//		UNIT["Degree",0.017453292519943295]]
+//
+// Each node is a keyword, followed by a bracketed list of values, which
+// are quoted strings, numbers, or more nodes.  Either [] or () can be
+// used for the brackets.  WktNode keeps the plain values in order, and
+// the nested nodes separately, since the coordinate system code looks
+// those up by keyword.
+//
+// Usage:
+//	WktNode root;
+//	ByteSpan s(text);
+//	if (root.readFromStream(s))
+//	{
+//		const WktNode* spheroid = root.find("SPHEROID");
+//		double a = spheroid->number(1);
+//	}
+//
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "bspan.h"
+
+
+namespace waavs {
+	static bool wktEqualNoCase(const std::string& a, const char* b) noexcept
+	{
+		size_t i = 0;
+		for (; i < a.size() && b[i] != 0; i++)
+		{
+			char ca = a[i];
+			char cb = b[i];
+			if (ca >= 'a' && ca <= 'z') ca -= 32;
+			if (cb >= 'a' && cb <= 'z') cb -= 32;
+			if (ca != cb)
+				return false;
+		}
+
+		return i == a.size() && b[i] == 0;
+	}
+
+	struct WktNode
+	{
+		std::string fKeyword{};
+		std::vector<std::string> fValues{};
+		std::vector<WktNode> fChildren{};
+
+		const std::string& keyword() const { return fKeyword; }
+		size_t numValues() const { return fValues.size(); }
+		const std::vector<WktNode>& children() const { return fChildren; }
+
+		bool is(const char* kw) const { return wktEqualNoCase(fKeyword, kw); }
+
+		// The first value is the name, for nodes that have one
+		const std::string& name() const
+		{
+			static const std::string empty{};
+			return fValues.empty() ? empty : fValues[0];
+		}
+
+		double number(size_t i, double defValue = 0) const
+		{
+			if (i >= fValues.size())
+				return defValue;
+
+			const char* s = fValues[i].c_str();
+			char* end = nullptr;
+			double v = strtod(s, &end);
+			return (end == s) ? defValue : v;
+		}
+
+		// The first direct child with the keyword
+		const WktNode* child(const char* kw) const
+		{
+			for (const WktNode& c : fChildren)
+				if (c.is(kw))
+					return &c;
+			return nullptr;
+		}
+
+		// The first node with the keyword, this one or anywhere below it
+		const WktNode* find(const char* kw) const
+		{
+			if (is(kw))
+				return this;
+
+			for (const WktNode& c : fChildren)
+			{
+				const WktNode* found = c.find(kw);
+				if (found)
+					return found;
+			}
+			return nullptr;
+		}
+
+		// Parse a single node, and everything within it
+		bool readFromStream(ByteSpan& bs)
+		{
+			fKeyword.clear();
+			fValues.clear();
+			fChildren.clear();
+
+			skipSpace(bs);
+			while (bs.size() > 0 && isKeywordChar(*bs))
+			{
+				fKeyword.push_back((char)*bs);
+				bs.skip(1);
+			}
+			if (fKeyword.empty())
+				return false;
+
+			skipSpace(bs);
+			if (bs.size() == 0 || (*bs != '[' && *bs != '('))
+				return false;
+			uint8_t closer = (*bs == '[') ? ']' : ')';
+			bs.skip(1);
+
+			while (true)
+			{
+				skipSpace(bs);
+				if (bs.size() == 0)
+					return false;
+
+				uint8_t c = *bs;
+				if (c == closer)
+				{
+					bs.skip(1);
+					return true;
+				}
+
+				if (c == '"')
+				{
+					std::string value;
+					if (!readQuoted(bs, value))
+						return false;
+					fValues.push_back(std::move(value));
+				}
+				else if (isKeywordChar(c) && !isNumberStart(c))
+				{
+					// could be a nested node, or a bare word, such as an axis direction
+					ByteSpan save = bs;
+					WktNode node;
+					if (node.readFromStream(bs))
+					{
+						fChildren.push_back(std::move(node));
+					}
+					else {
+						bs = save;
+						std::string word;
+						while (bs.size() > 0 && isKeywordChar(*bs))
+						{
+							word.push_back((char)*bs);
+							bs.skip(1);
+						}
+						fValues.push_back(std::move(word));
+					}
+				}
+				else {
+					std::string value;
+					while (bs.size() > 0 && *bs != ',' && *bs != closer && !isSpace(*bs))
+					{
+						value.push_back((char)*bs);
+						bs.skip(1);
+					}
+					if (value.empty())
+						return false;
+					fValues.push_back(std::move(value));
+				}
+
+				skipSpace(bs);
+				if (bs.size() > 0 && *bs == ',')
+					bs.skip(1);
+			}
+		}
+
+	private:
+		static bool isSpace(uint8_t c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v'; }
+		static bool isKeywordChar(uint8_t c) { return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_'; }
+		static bool isNumberStart(uint8_t c) { return (c >= '0' && c <= '9'); }
+
+		static void skipSpace(ByteSpan& bs)
+		{
+			while (bs.size() > 0 && isSpace(*bs))
+				bs.skip(1);
+		}
+
+		// A quoted string, where "" stands for a single "
+		static bool readQuoted(ByteSpan& bs, std::string& value)
+		{
+			bs.skip(1);
+			while (bs.size() > 0)
+			{
+				uint8_t c = *bs;
+				bs.skip(1);
+				if (c == '"')
+				{
+					if (bs.size() > 0 && *bs == '"')
+					{
+						value.push_back('"');
+						bs.skip(1);
+						continue;
+					}
+					return true;
+				}
+				value.push_back((char)c);
+			}
+
+			return false;
+		}
+	};
+}
@@ -0,0 +1,162 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+#include "mercator.h"
+
+using namespace waavs;
+
+//
+// mercapprox
+//
+// Check MercatorApprox against the exact projection, across the whole
+// Web Mercator latitude range, for a range of error tolerances, and
+// check its scalar and AVX2 kernels give the same bits.
+//
+// Returns 0 if everything passes, 1 otherwise.
+//
+
+static constexpr size_t kSweepPoints = 2000000;
+
+// Latitudes from one limit to the other, evenly, then a few that
+// need care, the equator, the limits, and past them
+static void makeLatitudes(std::vector<double>& lat, std::vector<double>& lon)
+{
+	lat.clear();
+	lon.clear();
+
+	for (size_t i = 0; i <= kSweepPoints; i++)
+	{
+		double t = (double)i / (double)kSweepPoints;
+		lat.push_back(-MercatorApprox::kMaxLatitude + (2 * MercatorApprox::kMaxLatitude * t));
+		lon.push_back(-180.0 + (360.0 * t));
+	}
+
+	const double extras[] = { 0.0, -0.0, 1e-300, -1e-9, 45.0, -45.0,
+		85.0511, -85.0511, MercatorApprox::kMaxLatitude, -MercatorApprox::kMaxLatitude,
+		85.06, -85.06, 89.9, 90.0, -90.0 };
+	for (double v : extras)
+	{
+		lat.push_back(v);
+		lon.push_back(v * 2);
+	}
+}
+
+// The largest y difference from the exact projection, in meters, over
+// the points within the Web Mercator range, and whether x matched
+static double compareWithExact(const std::vector<double>& lat, const std::vector<double>& approxY,
+	const std::vector<double>& exactY, const std::vector<double>& approxX, const std::vector<double>& exactX, bool& xSame)
+{
+	double worst = 0;
+	xSame = true;
+	for (size_t i = 0; i < lat.size(); i++)
+	{
+		if (approxX[i] != exactX[i])
+			xSame = false;
+
+		if (std::fabs(lat[i]) > MercatorApprox::kMaxLatitude)
+			continue;
+
+		double err = std::fabs(approxY[i] - exactY[i]);
+		worst = err > worst ? err : worst;
+	}
+
+	return worst;
+}
+
+// Latitudes past the limits come out the same as the limit itself
+static bool clampsPastLimits(const MercatorApprox& approx, const std::vector<double>& lat, const std::vector<double>& y)
+{
+	for (size_t i = 0; i < lat.size(); i++)
+	{
+		if (std::fabs(lat[i]) <= MercatorApprox::kMaxLatitude)
+			continue;
+
+		double limit = std::copysign(MercatorApprox::kMaxLatitude, lat[i]);
+		double lon = 0, lx = 0, ly = 0;
+		approx.project(&limit, &lon, &lx, &ly, 1, MercatorKernel::Scalar);
+		if (ly != y[i])
+			return false;
+	}
+
+	return true;
+}
+
+static bool sameBits(const std::vector<double>& a, const std::vector<double>& b)
+{
+	return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(double)) == 0;
+}
+
+int main()
+{
+	std::vector<double> lat;
+	std::vector<double> lon;
+	makeLatitudes(lat, lon);
+
+	size_t n = lat.size();
+	std::vector<double> exactX(n), exactY(n);
+	latLongToMercatorSVG(lat.data(), lon.data(), exactX.data(), exactY.data(), n);
+
+	bool hasAVX2 = mercatorKernel() == MercatorKernel::AVX2;
+	if (!hasAVX2)
+		printf("No AVX2 on this machine, only the scalar kernel is checked\n");
+
+	const double tolerances[] = { 100.0, 10.0, 1.0, 0.1, 0.01, 0.001 };
+	int failures = 0;
+
+	for (double tol : tolerances)
+	{
+		MercatorApprox approx(tol);
+
+		std::vector<double> sx(n), sy(n);
+		approx.project(lat.data(), lon.data(), sx.data(), sy.data(), n, MercatorKernel::Scalar);
+
+		bool xSame = true;
+		double sweepErr = compareWithExact(lat, sy, exactY, sx, exactX, xSame);
+		double measured = approx.measureError();
+
+		bool clamped = clampsPastLimits(approx, lat, sy);
+		bool ok = xSame && clamped;
+		if (approx.meetsError())
+			ok = ok && (sweepErr <= tol) && (measured <= tol);
+
+		bool kernelsAgree = true;
+		if (hasAVX2)
+		{
+			std::vector<double> vx(n), vy(n);
+			approx.project(lat.data(), lon.data(), vx.data(), vy.data(), n, MercatorKernel::AVX2);
+			kernelsAgree = sameBits(sx, vx) && sameBits(sy, vy);
+			ok = ok && kernelsAgree;
+		}
+
+		printf("%8g m: %6zu segments, fit %.3g m, sweep %.3g m, measureError %.3g m, %s%s%s%s%s\n",
+			tol, approx.numSegments(), approx.fitError(), sweepErr, measured,
+			approx.meetsError() ? "" : "not met, ",
+			xSame ? "" : "x differs, ",
+			clamped ? "" : "not clamped, ",
+			kernelsAgree ? "" : "kernels differ, ",
+			ok ? "ok" : "FAILED");
+
+		if (!ok)
+			failures++;
+	}
+
+	// A tolerance that can't be met, has to say so
+	MercatorApprox tooTight(1e-12);
+	bool flagged = !tooTight.meetsError() && tooTight.numSegments() == (size_t)MercatorApprox::kMaxSegments;
+	printf("%8g m: %6zu segments, fit %.3g m, %s\n", tooTight.maxError(), tooTight.numSegments(), tooTight.fitError(),
+		flagged ? "not met, as expected, ok" : "FAILED");
+	if (!flagged)
+		failures++;
+
+	if (failures > 0)
+	{
+		printf("%d FAILED\n", failures);
+		return 1;
+	}
+
+	printf("all passed\n");
+	return 0;
+}
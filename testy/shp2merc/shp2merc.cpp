@@ -1,16 +1,34 @@
 
 
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <vector>
 #include <map>
 
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
 
 #include "bspan.h"
 #include "mappedfile.h"
 #include "mercator.h"
+#include "projection.h"
 
 #include "shapefile.h"
+#include "shpreader.h"
+#include "shpscan.h"
+#include "shpgeometry.h"
+#include "shpmultipatch.h"
 #include "shputil.h"
+#include "shpview.h"
+#include "shpvisit.h"
+#include "shppipeline.h"
+#include "svgwriter.h"
+#include "simplify.h"
 
 
 
@@ -18,215 +36,517 @@
 int gargc;
 char** gargv;
 
+// The coordinate system of the .shp, from the .prj next to it
+// When there isn't one, the coordinates are taken to be lon/lat
+std::shared_ptr<waavs::Projection> gSourceProjection{};
+
+// When above zero, projected coordinates are interpolated from a grid
+// over the layer, good to within this many of the layer's units
+double gGridTolerance{ 0 };
+
+// Everything goes out through here, rather than printf
+waavs::SvgWriter gOut(1);
+
+// Threads for formatting records, 0 for all of them
+unsigned gThreads{ 0 };
+
+// When 0 or more, paths are written with relative commands, with
+// coordinates rounded to this many decimal places
+int gRelativeDigits{ -1 };
+
+// The size of the picture, in pixels across, 0 for one pixel to
+// the svg unit (a meter)
+double gWidthPixels{ 0 };
+double gUnitsPerPixel{ 1 };
+
+// Simplify lines and rings, after projecting, to within
+// this many pixels
+waavs::SimplifyMethod gSimplify{ waavs::SimplifyMethod::None };
+double gSimplifyPixels{ 0.5 };
+
+// When above zero, vertices are snapped to a grid this many pixels
+// across, and rings or records smaller than that are left out
+double gSnapPixels{ 0 };
+
+// The top left of the picture, where the pixel grid starts
+double gOriginX{ 0 };
+double gOriginY{ 0 };
+
 
 using namespace waavs;
 
 
 
-static void mercPrintPoint(ByteSpan& bs)
+// Bring coordinates from the source coordinate system back to lon/lat
+static void mercUnproject(double* lon, double* lat, size_t count)
+{
+	if (gSourceProjection && !gSourceProjection->isGeographic())
+		gSourceProjection->inverse(lon, lat, lon, lat, count);
+}
+
+// Swap the exact projection for a grid over the layer, if asked to
+static void mercUseGrid(const ShapefileHeader& hdr)
 {
-	waavs::ShpPoint pt{};
-	if (!pt.readFromStream(bs))
+	if (gGridTolerance <= 0 || !gSourceProjection || gSourceProjection->isGeographic())
+		return;
+
+	auto grid = GridProjection::create_shared(gSourceProjection, hdr.xMin, hdr.yMin, hdr.xMax, hdr.yMax, gGridTolerance);
+
+	// Too fine a tolerance for the grid to reach, so stay exact
+	if (!grid->meetsError())
 	{
-		printf("Failed to parse point\n");
+		fprintf(stderr, "Grid only reached %g of the %g asked for, using the exact projection\n",
+			grid->inverseGrid().fitError(), gGridTolerance);
 		return;
 	}
 
+	gSourceProjection = grid;
+}
+
+static void mercLatLongToSVG(double lat, double lon, double& pixelX, double& pixelY)
+{
+	mercUnproject(&lon, &lat, 1);
+	latLongToMercatorSVG(lat, lon, pixelX, pixelY);
+}
+
+static void mercPrintPoint(SvgWriter& out, const ShpPointView& pt)
+{
 	double pixelX{ 0 };
 	double pixelY{ 0 };
 	
-	latLongToMercatorSVG(pt.numbers()[1], pt.numbers()[0], pixelX, pixelY);
+	mercLatLongToSVG(pt.y, pt.x, pixelX, pixelY);
 
 	
-	printf("<path d='%3.4f, %3.4f'/>\n", pixelX, pixelY);
+	out.write("<path d='");
+	out.number(pixelX);
+	out.write(", ");
+	out.number(pixelY);
+	out.write("'/>\n");
 }
 
-static void mercPrintMultiPoint(ByteSpan& bs)
+// The whole projection, from the layer's coordinates to the svg, done
+// in place on a block of points
+struct MercProject
 {
-	waavs::ShpMultiPoint mp{};
-	if (!mp.readFromStream(bs))
+	void operator()(double* xs, double* ys, size_t count) const
 	{
-		printf("Failed to parse multi-point\n");
-		return;
+		mercUnproject(xs, ys, count);
+		latLongToMercatorSVG(ys, xs, xs, ys, count);
 	}
+};
+
+static void mercPrintMultiPoint(SvgWriter& out, const ShpMultiPointView& mp)
+{
+	//printf("MultiPoint: [%zd] points\n", pts.size());
+	shpProjectEmit(mp.points(), MercProject{}, [&out](const double* xs, const double* ys, size_t count) {
+		for (size_t i = 0; i < count; i++)
+		{
+			out.write("M ");
+			out.number(xs[i]);
+			out.write(", ");
+			out.number(ys[i]);
+			out.put('\n');
+		}
+	});
+}
+
+// Whether a record's bounding box, once projected, fits in a grid cell,
+// so there's nothing to see
+static bool mercBelowGrid(const ShpMultiPartView& pl)
+{
+	if (gSnapPixels <= 0)
+		return false;
+
+	double xs[4]{ pl.xMin, pl.xMax, pl.xMin, pl.xMax };
+	double ys[4]{ pl.yMin, pl.yMin, pl.yMax, pl.yMax };
+	MercProject{}(xs, ys, 4);
 
-	size_t numPoints = mp.numbers().size() / 2;
+	return simplifyExtentBelow(xs, ys, 4, gSnapPixels * gUnitsPerPixel);
+}
 
-	//printf("MultiPoint: [%zd] points\n", numPoints);
-	for (size_t i = 0; i < numPoints; i++)
+// Project the points of a part, simplifying and snapping them if asked
+// to, and hand them to emit(xs, ys, count)
+// Returns false if the part was left out.
+template <typename Emit>
+static bool mercEmitPart(const ShpPointArray& pts, bool closed, Emit&& emit)
+{
+	if (gSimplify == SimplifyMethod::None && gSnapPixels <= 0)
 	{
-		double pixelX{ 0 };
-		double pixelY{ 0 };
+		shpProjectEmit(pts, MercProject{}, emit);
+		return true;
+	}
 
-		latLongToMercatorSVG(mp.numbers()[(i * 2) + 1], mp.numbers()[(i * 2)], pixelX, pixelY);
-		
-		printf("M %3.4f, %3.4f\n", pixelX, pixelY);
+	// The whole ring is needed to simplify it, or to know its size,
+	// so it's gathered here, and the storage kept for the next one
+	static thread_local PathSimplifier simp{};
+	simp.setMethod(gSimplify, gSimplifyPixels * gUnitsPerPixel);
+	simp.reset();
+	shpProjectEmit(pts, MercProject{}, [](const double* xs, const double* ys, size_t count) {
+		simp.add(xs, ys, count);
+	});
+
+	double cell = gSnapPixels * gUnitsPerPixel;
+	if (cell > 0 && simp.extentBelow(cell))
+		return false;
+
+	size_t kept = simp.simplify(closed);
+	if (cell > 0)
+	{
+		// a ring that's down to fewer than three corners has no area
+		kept = simp.snap(cell, gOriginX, gOriginY);
+		if (kept < simplifyMinPoints(closed))
+			return false;
+	}
+
+	emit(simp.x(), simp.y(), kept);
+	return true;
+}
+
+// The compact form, relative commands and as few characters as possible
+static void mercPrintPathRelative(SvgWriter& out, const ShpMultiPartView& pl, bool closeIt)
+{
+	// the path is only started once there's a part to put in it,
+	// since snapping can leave all of them out
+	bool opened = false;
+	{
+		SvgPathEncoder enc(out, gRelativeDigits);
+		for (size_t i = 0; i < pl.numParts(); i++)
+		{
+			bool first = true;
+			mercEmitPart(pl.part(i), closeIt, [&](const double* xs, const double* ys, size_t count) {
+				size_t j = 0;
+				if (first && count > 0)
+				{
+					if (!opened)
+					{
+						out.write("<path d=\"");
+						opened = true;
+					}
+					enc.moveTo(xs[0], ys[0]);
+					first = false;
+					j = 1;
+				}
+				enc.lineTo(xs + j, ys + j, count - j);
+			});
+
+			if (closeIt && !first)
+				enc.close();
+		}
 	}
+	if (opened)
+		out.write("\"/>\n");
 }
 
-static void mercPrintPolyLine(ByteSpan& bs, bool closeIt = false)
+static void mercPrintPolyLine(SvgWriter& out, const ShpMultiPartView& pl, bool closeIt = false)
 {
-	waavs::ShpPolyLine pl{};
-	if (!pl.readFromStream(bs))
+	if (mercBelowGrid(pl))
+		return;
+
+	if (gRelativeDigits >= 0)
 	{
-		printf("Failed to parse polyline\n");
+		mercPrintPathRelative(out, pl, closeIt);
 		return;
 	}
 
-	size_t numParts = pl.parts().size();
-	size_t numPoints = pl.numbers().size() / 2;
+	size_t numParts = pl.numParts();
 
 	//printf("<path fill='none' stroke='black' stroke-width=\"0.0001\" d=\"");
-	printf("<path  d=\"");
+	// the path is only started once there's a part to put in it,
+	// since snapping can leave all of them out
+	bool opened = false;
 	for (size_t i = 0; i < numParts; i++)
 	{
 		// each part begins with 'M', and ends with 'Z'
-		size_t partStart = pl.parts()[i];
-		size_t partEnd = (i + 1 < numParts) ? pl.parts()[i + 1] : numPoints;
-
-		printf("M ");
-		//printf("Part [%zd]: [%zd] points\n", i, partEnd - partStart);
-		for (size_t j = partStart; j < partEnd; j++)
-		{
-			double pixelX{ 0 };
-			double pixelY{ 0 };
-
-			latLongToMercatorSVG(pl.numbers()[(j * 2) + 1], pl.numbers()[(j * 2)], pixelX, pixelY);
-			
-			printf(" %3.4f, %3.4f", pixelX, pixelY);
-		}
+		//printf("Part [%zd]: [%zd] points\n", i, pts.size());
+		bool emitted = mercEmitPart(pl.part(i), closeIt, [&out, &opened, first = true](const double* xs, const double* ys, size_t count) mutable {
+			if (first)
+			{
+				if (!opened)
+				{
+					out.write("<path  d=\"");
+					opened = true;
+				}
+				out.write("M ");
+				first = false;
+			}
+			out.points(xs, ys, count);
+		});
 		
-		if (closeIt) {
-			printf(" Z");
+		if (closeIt && emitted) {
+			out.write(" Z");
 		}
 	}
-	printf("\"/>\n");
+	if (opened)
+		out.write("\"/>\n");
 }
 
-void printShpFile(ShpFile& shp)
+// Draw the footprint of a MultiPatch, as the triangles it decodes into
+static void mercPrintMultiPatch(SvgWriter& out, const ShpMultiPatch& mesh)
 {
-	double minX{0};
-	double minY{0};
-	latLongToMercatorSVG(shp.yMax, shp.xMin, minX, minY);
-	
+	const std::vector<double>& verts = mesh.vertices();
+	const std::vector<uint32_t>& tris = mesh.indices();
+
+	out.write("<path  d=\"");
+	for (size_t i = 0; i < tris.size(); i++)
+	{
+		double pixelX{ 0 };
+		double pixelY{ 0 };
+		const double* v = &verts[(size_t)tris[i] * 3];
+
+		mercLatLongToSVG(v[1], v[0], pixelX, pixelY);
+
+		if ((i % 3) == 0)
+			out.put('M');
+		out.points(&pixelX, &pixelY, 1);
+		if ((i % 3) == 2)
+			out.write(" Z");
+	}
+	out.write("\"/>\n");
+}
+
+// The Z and M types come through as their 2D views, as only
+// the x/y values are needed for the svg
+struct MercSvgPrinter
+{
+	SvgWriter& out;
+
+	void operator()(const ShpNullView&) { out.write("Null Shape\n"); }
+	void operator()(const ShpPointView& pt) { mercPrintPoint(out, pt); }
+	void operator()(const ShpPolyLineView& pl) { mercPrintPolyLine(out, pl); }
+	void operator()(const ShpPolygonView& pg) { mercPrintPolyLine(out, pg, true); }
+	void operator()(const ShpMultiPointView& mp) { mercPrintMultiPoint(out, mp); }
+	void operator()(const ShpMultiPatch& mesh) { mercPrintMultiPatch(out, mesh); }
+};
+
+static void printSvgHeader(const ShapefileHeader& shp)
+{
+	// In a projected coordinate system the edges of the bounding box
+	// are curves once they're unprojected, so take the extent from
+	// points all along them
+	double minX{ 0 };
+	double minY{ 0 };
 	double maxX{ 0 };
 	double maxY{ 0 };
-	latLongToMercatorSVG(shp.yMin, shp.xMax, maxX, maxY);
+	projEdgeExtent(shp.xMin, shp.yMin, shp.xMax, shp.yMax, [](double* xs, double* ys, size_t n) {
+		mercUnproject(xs, ys, n);
+		for (size_t i = 0; i < n; i++)
+			latLongToMercatorSVG(ys[i], xs[i], xs[i], ys[i]);
+	}, minX, minY, maxX, maxY);
 
 	double lenX = maxX - minX;
 	double lenY = maxY - minY;
+
+	// Simplifying is in pixels, of a picture this wide
+	gUnitsPerPixel = (gWidthPixels > 0 && lenX > 0) ? lenX / gWidthPixels : 1.0;
+	gOriginX = minX;
+	gOriginY = minY;
 	
-	printf("<svg \n");
-	printf("  xmlns='http://www.w3.org/2000/svg'\n");
-	printf("  xmlns:waavs='https:william-a-adams.com/namespaces/waavs'\n");
-	printf("  xmlns:waavsgeo='https:william-a-adams.com/namespaces/waavs'\n");
-	printf("  width='%3.4f' height='%3.4f'\n", lenX, lenY);
-	printf("  viewBox ='%3.4f %3.4f %3.4f %3.4f' \n", minX, minY, lenX, lenY);
-	printf(">\n");
+	gOut.write("<svg \n");
+	gOut.write("  xmlns='http://www.w3.org/2000/svg'\n");
+	gOut.write("  xmlns:waavs='https:william-a-adams.com/namespaces/waavs'\n");
+	gOut.write("  xmlns:waavsgeo='https:william-a-adams.com/namespaces/waavs'\n");
+	gOut.format("  width='%3.4f' height='%3.4f'\n", lenX / gUnitsPerPixel, lenY / gUnitsPerPixel);
+	gOut.format("  viewBox ='%3.4f %3.4f %3.4f %3.4f' \n", minX, minY, lenX, lenY);
+	gOut.write(">\n");
+
+	gOut.write("<style>\n");
+	gOut.write("  svg {stroke-width:0.5;stroke:black;vector-effect:non-scaling-stroke;fill:black;}\n");
+	gOut.write("  path {paint-order:fill,stroke;stroke-width:0.5;stroke:black;vector-effect:non-scaling-stroke;fill:beige;}\n");
+	gOut.write("</style>\n");
+}
 
-	printf("<style>\n");
-	printf("  svg {stroke-width:0.5;stroke:black;vector-effect:non-scaling-stroke;fill:black;}\n");
-	printf("  path {paint-order:fill,stroke;stroke-width:0.5;stroke:black;vector-effect:non-scaling-stroke;fill:beige;}\n");
-	printf("</style>\n");
+static void printSvgFooter()
+{
+	gOut.write("</svg>\n");
+}
 
+static void printShpRecord(SvgWriter& out, const ShpRecord& rec)
+{
+	//printf("============================================\n");
+	//printf("Record Number: %d\n", rec.fRecordNumber);
+	//printf("Record Size: %zd\n", rec.recordSize());
+	//printf("Content Size: %zd\n", rec.contentSize());
+	//printf("Content Span : %zd\n", rec.content().size());
+	//printf("Shape Type: %d\n", rec.shapeType());
+
+	if (!visitShape(rec, MercSvgPrinter{ out }))
+		out.format("Failed to parse shape type: %d\n", (int)rec.shapeType());
+}
 
+void printShpFile(ShpFile& shp)
+{
+	printSvgHeader(shp);
 
-	for (const ShpRecord& rec : shp.records())
-	{
-		//printf("============================================\n");
-		//printf("Record Number: %d\n", rec.fRecordNumber);
-		//printf("Record Size: %zd\n", rec.recordSize());
-		//printf("Content Size: %zd\n", rec.contentSize());
-		//printf("Content Span : %zd\n", rec.content().size());
-		//printf("Shape Type: %d\n", rec.shapeType());
+	// The records are formatted on all the cores, and written in order
+	const ShpRecordTable& table = shp.records();
+	shpEmitOrdered(table.size(), gThreads, gOut, [&table](SvgWriter& out, size_t first, size_t last) {
+		for (size_t i = first; i < last; i++)
+			printShpRecord(out, table.at(i));
+	});
 
+	printSvgFooter();
+}
 
-		// create a stream on the record content
-		ByteSpan rs(rec.content());
+// Convert .shp content coming in on a stream, such as stdin
+// Only one record is held in memory at a time
+static bool convertShpStream(FILE* f)
+{
+	ShpStreamReader reader(f);
+	if (!reader.readHeader())
+	{
+		fprintf(stderr, "Failed to read shp header\n");
+		return false;
+	}
 
-		switch (rec.shapeType())
-		{
-		case ShpShapeType::NullShape:
-			printf("Null Shape\n");
-			break;
-		case ShpShapeType::Point:
-			//printf("== Point ==\n");
-			mercPrintPoint(rs);
-			break;
-		case ShpShapeType::PolyLine:
-			//printf("PolyLine\n");
-			mercPrintPolyLine(rs);
-			break;
-		case ShpShapeType::Polygon:
-			//printf("== Polygon ==\n");
-			mercPrintPolyLine(rs, true);
-			break;
-		case ShpShapeType::MultiPoint:
-			//printf("== MultiPoint ==\n");
-			mercPrintMultiPoint(rs);
-			break;
-		case ShpShapeType::PointZ:
-			printf("PointZ\n");
-			break;
-		case ShpShapeType::PolyLineZ:
-			printf("PolyLineZ\n");
-			break;
-		case ShpShapeType::PolygonZ:
-			printf("<!-- PolygonZ -->\n");
-			mercPrintPolyLine(rs, true);
-			break;
-		case ShpShapeType::MultiPointZ:
-			printf("MultiPointZ\n");
-
-			break;
-		case ShpShapeType::PointM:
-			printf("PointM\n");
-			break;
-		case ShpShapeType::PolyLineM:
-			printf("PolyLineM\n");
-			break;
-		case ShpShapeType::PolygonM:
-			printf("PolygonM\n");
-			break;
-		case ShpShapeType::MultiPointM:
-			printf("MultiPointM\n");
-			break;
-		case ShpShapeType::MultiPatch:
-			printf("MultiPatch\n");
-			break;
-		default:
-			printf("Unknown Shape Type\n");
-			break;
-		}
+	mercUseGrid(reader.header());
+	printSvgHeader(reader.header());
+
+	ShpRecord rec;
+	while (reader.next(rec))
+	{
+		printShpRecord(gOut, rec);
 	}
 
-	printf("</svg>\n");
+	printSvgFooter();
+
+	if (reader.hasError())
+	{
+		gOut.format("<!-- Truncated shp stream at offset: %llu -->\n", (unsigned long long)reader.offset());
+		fprintf(stderr, "Truncated shp stream at offset: %llu\n", (unsigned long long)reader.offset());
+		return false;
+	}
 
+	return true;
 }
 
-static void convertShpFile(const char *filename)
+static bool convertShpFile(const char *filename)
 {
 	std::string shpFilename = filename;
-	auto shpFile = MappedFile::create_shared(shpFilename);
+	auto shpFile = MappedFile::create_shared(shpFilename, MapAccess::Sequential);
 
 	if (!shpFile)
 	{
-		printf("Failed to open shp file: %s\n", filename);
-		return;
+		fprintf(stderr, "Failed to open shp file: %s\n", filename);
+		return false;
 	}
 
 	ByteSpan shpChunk(shpFile->data(), shpFile->size());
 
+	// The coordinate system, if there's a .prj
+	std::filesystem::path prjPath(shpFilename);
+	prjPath.replace_extension(".prj");
+	if (std::filesystem::exists(prjPath))
+	{
+		auto prjFile = MappedFile::create_shared(prjPath.string(), MapAccess::Sequential);
+		if (prjFile)
+		{
+			std::string wkt((const char*)prjFile->data(), prjFile->size());
+			gSourceProjection = Projection::create_shared(wkt);
+			if (!gSourceProjection)
+				fprintf(stderr, "Unsupported coordinate system in: %s\n", prjPath.string().c_str());
+		}
+	}
+
 	//BStream shpStream(shpChunk);
 
+	// If there's an index sitting next to the .shp, use it
+	// to drive the parallel record scan
+	std::filesystem::path shxPath(shpFilename);
+	shxPath.replace_extension(".shx");
+
+	std::shared_ptr<MappedFile> shxFile{};
+	ShxIndex shx(shxPath.string());
+	ShxIndex* shxPtr = nullptr;
+	if (std::filesystem::exists(shxPath))
+	{
+		shxFile = MappedFile::create_shared(shxPath.string(), MapAccess::Sequential);
+		if (shxFile)
+		{
+			ByteSpan shxChunk(shxFile->data(), shxFile->size());
+			if (shx.readFromStream(shxChunk))
+				shxPtr = &shx;
+		}
+	}
+
 	ShpFile shp(shpFilename);
-	if (!shp.readFromStream(shpChunk))
+	if (!readShpFileParallel(shp, shpChunk, shxPtr))
 	{
-		printf("Failed to parse shp file\n");
-		return;
+		fprintf(stderr, "Failed to parse shp file: %s\n", filename);
+		return false;
 	}
 
+	mercUseGrid(shp);
 	printShpFile(shp);
+
+	return true;
+}
+
+static void printUsage(FILE* f)
+{
+	fprintf(f, "Usage: shp2merc <filename> [options]\n");
+	fprintf(f, "       use '-' as the filename to read from stdin\n");
+	fprintf(f, "  -grid <tolerance>   interpolate projected coordinates, to within tolerance, in the layer's units\n");
+	fprintf(f, "  -threads <n>        threads to format records with, 0 (the default) for all of them\n");
+	fprintf(f, "  -relative <digits>  write paths with relative commands, rounded to digits decimal places\n");
+	fprintf(f, "  -width <pixels>     the width of the picture, the height follows\n");
+	fprintf(f, "  -simplify <dp|vw>   simplify lines and rings, Douglas-Peucker or Visvalingam-Whyatt\n");
+	fprintf(f, "  -tolerance <pixels> how far simplifying can move a line, 0.5 by default\n");
+	fprintf(f, "  -snap <pixels>      snap vertices to a grid, leaving out anything smaller than a cell\n");
+}
+
+// Every option takes a value.  Anything that isn't a known option,
+// or an option with nothing after it, is an error, rather than being
+// skipped, as that would quietly shift the options that follow.
+static bool parseOptions(int argc, char** argv)
+{
+	for (int i = 2; i < argc; i += 2)
+	{
+		const char* opt = argv[i];
+
+		if (opt[0] != '-' || opt[1] == 0)
+		{
+			fprintf(stderr, "Unexpected argument: %s\n", opt);
+			return false;
+		}
+
+		if (i + 1 >= argc)
+		{
+			fprintf(stderr, "Missing value for %s\n", opt);
+			return false;
+		}
+
+		const char* value = argv[i + 1];
+
+		if (strcmp(opt, "-grid") == 0)
+			gGridTolerance = atof(value);
+		else if (strcmp(opt, "-threads") == 0)
+			gThreads = (unsigned)atoi(value);
+		else if (strcmp(opt, "-relative") == 0)
+			gRelativeDigits = atoi(value);
+		else if (strcmp(opt, "-width") == 0)
+			gWidthPixels = atof(value);
+		else if (strcmp(opt, "-tolerance") == 0)
+			gSimplifyPixels = atof(value);
+		else if (strcmp(opt, "-snap") == 0)
+			gSnapPixels = atof(value);
+		else if (strcmp(opt, "-simplify") == 0)
+		{
+			if (strcmp(value, "dp") == 0)
+				gSimplify = SimplifyMethod::DouglasPeucker;
+			else if (strcmp(value, "vw") == 0)
+				gSimplify = SimplifyMethod::Visvalingam;
+			else {
+				fprintf(stderr, "Unknown simplification: %s\n", value);
+				return false;
+			}
+		}
+		else {
+			fprintf(stderr, "Unknown option: %s\n", opt);
+			return false;
+		}
+	}
+
+	return true;
 }
 
 int main(int argc, char** argv)
@@ -238,13 +558,37 @@ int main(int argc, char** argv)
 
 	if (argc < 2)
 	{
-		printf("Usage: shp2merc <filename>\n");
+		printUsage(stdout);
 		return 0;
 	}
 
+	if (!parseOptions(argc, argv))
+	{
+		printUsage(stderr);
+		return 2;
+	}
+
 	const char * filename = gargv[1];
-	
-	convertShpFile(filename);
+	bool converted = false;
+
+	if (strcmp(filename, "-") == 0)
+	{
+		// the shp content is binary, so no newline translation
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+#endif
+		converted = convertShpStream(stdin);
+	}
+	else
+		converted = convertShpFile(filename);
+
+	// The writer doesn't go through stdio, so nothing else will
+	// notice if the output couldn't be written
+	if (!gOut.flush())
+	{
+		fprintf(stderr, "Failed to write the svg\n");
+		return 1;
+	}
 
-	return 1;
+	return converted ? 0 : 1;
 }
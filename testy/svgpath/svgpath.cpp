@@ -0,0 +1,624 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "svgwriter.h"
+#include "simplify.h"
+
+using namespace waavs;
+
+//
+// svgpath
+//
+// Check SvgPathEncoder, by reading back what it writes with a parser
+// that follows the SVG path grammar, and the line simplifiers, for the
+// things they promise, Douglas-Peucker staying within the tolerance,
+// rings staying closed with enough vertices, and snapping leaving no
+// repeated points.
+//
+// Returns 0 if everything passes, 1 otherwise.
+//
+
+static int gFailures = 0;
+
+static void check(bool ok, const char* what)
+{
+	if (!ok)
+	{
+		printf("  FAILED: %s\n", what);
+		gFailures++;
+	}
+}
+
+//
+// Path data, read back
+//
+
+struct PathPoint
+{
+	int64_t x;		// in steps of the encoder's grid
+	int64_t y;
+};
+
+struct SubPath
+{
+	std::vector<PathPoint> points{};
+	bool closed{ false };
+};
+
+// Reads path data made of M m L l H h V v Z z, with the SVG rules for
+// where numbers end, and what a command letter left out means.
+// Numbers are turned into whole steps of 10^-digits, so there's no
+// rounding in adding up relative moves.
+struct PathReader
+{
+	const char* fP;
+	int fDigits;
+	bool fOk{ true };
+
+	PathReader(const char* p, int digits) : fP(p), fDigits(digits) {}
+
+	void skipSeparators()
+	{
+		while (*fP == ' ' || *fP == ',' || *fP == '\n' || *fP == '\t')
+			fP++;
+	}
+
+	bool atNumber()
+	{
+		skipSeparators();
+		return *fP == '-' || *fP == '+' || *fP == '.' || (*fP >= '0' && *fP <= '9');
+	}
+
+	// sign? digits? ('.' digits)?, which is where "1.5.5" splits in two
+	int64_t number()
+	{
+		skipSeparators();
+		bool negative = false;
+		if (*fP == '-' || *fP == '+')
+			negative = *fP++ == '-';
+
+		int64_t whole = 0;
+		int count = 0;
+		while (*fP >= '0' && *fP <= '9')
+		{
+			whole = (whole * 10) + (*fP++ - '0');
+			count++;
+		}
+
+		int64_t frac = 0;
+		int fracDigits = 0;
+		if (*fP == '.')
+		{
+			fP++;
+			while (*fP >= '0' && *fP <= '9')
+			{
+				frac = (frac * 10) + (*fP++ - '0');
+				fracDigits++;
+				count++;
+			}
+		}
+
+		// more decimal places than the grid has is a mistake too
+		if (count == 0 || fracDigits > fDigits)
+			fOk = false;
+
+		for (int i = fracDigits; i < fDigits; i++)
+			frac *= 10;
+		int64_t scale = 1;
+		for (int i = 0; i < fDigits; i++)
+			scale *= 10;
+
+		int64_t steps = (whole * scale) + frac;
+		return negative ? -steps : steps;
+	}
+
+	bool read(std::vector<SubPath>& paths)
+	{
+		char cmd = 0;
+		int64_t x = 0, y = 0;
+		int64_t startX = 0, startY = 0;
+
+		while (fOk)
+		{
+			skipSeparators();
+			if (*fP == 0)
+				break;
+
+			if (!atNumber())
+			{
+				cmd = *fP++;
+				if (cmd == 'z' || cmd == 'Z')
+				{
+					if (paths.empty())
+						return false;
+					paths.back().closed = true;
+					x = startX;
+					y = startY;
+				}
+				continue;
+			}
+
+			switch (cmd)
+			{
+			case 'M':
+			case 'm':
+			{
+				int64_t nx = number();
+				int64_t ny = number();
+				x = (cmd == 'M') ? nx : x + nx;
+				y = (cmd == 'M') ? ny : y + ny;
+				startX = x;
+				startY = y;
+				paths.push_back({});
+				paths.back().points.push_back({ x, y });
+
+				// more pairs after a moveto are linetos, of the same kind
+				cmd = (cmd == 'M') ? 'L' : 'l';
+				continue;
+			}
+
+			case 'L':	x = number(); y = number(); break;
+			case 'l':	x += number(); y += number(); break;
+			case 'H':	x = number(); break;
+			case 'h':	x += number(); break;
+			case 'V':	y = number(); break;
+			case 'v':	y += number(); break;
+
+			default:
+				// a number with no command before it, or after a 'z'
+				return false;
+			}
+
+			if (paths.empty())
+				return false;
+			paths.back().points.push_back({ x, y });
+		}
+
+		return fOk;
+	}
+};
+
+//
+// Encoder
+//
+
+static std::string encode(int digits, const std::vector<std::vector<double>>& xs, const std::vector<std::vector<double>>& ys,
+	const std::vector<bool>& closed)
+{
+	SvgWriter out(SvgWriter::kMemory);
+	{
+		SvgPathEncoder enc(out, digits);
+		for (size_t s = 0; s < xs.size(); s++)
+		{
+			enc.moveTo(xs[s][0], ys[s][0]);
+			enc.lineTo(&xs[s][1], &ys[s][1], xs[s].size() - 1);
+			if (closed[s])
+				enc.close();
+		}
+	}
+
+	return std::string(out.data(), out.pending());
+}
+
+// A few paths where the exact text matters
+static void checkEncoderText()
+{
+	struct Case
+	{
+		const char* what;
+		int digits;
+		std::vector<double> x;
+		std::vector<double> y;
+		bool closed;
+		const char* expected;
+	};
+
+	const Case cases[] = {
+		{ "no separator before '-', or a '.' after a fraction", 1,
+			{ 0, 1.5, 1 }, { 0, 0.5, -1 }, false, "M0 0l1.5.5-.5-1.5" },
+		{ "h and v for flat segments, nothing for repeats", 2,
+			{ 0, 2, 2, 2, 0 }, { 0, 0, 0, 3.25, 3.25 }, false, "M0 0h2v3.25h-2" },
+		{ "the closing segment is left to z", 0,
+			{ 0, 10, 10, 0, 0 }, { 0, 0, 10, 10, 0 }, true, "M0 0h10v10h-10z" },
+		{ "rounding to the grid, not the differences", 0,
+			{ 0.4, 0.6, 1.4 }, { 0, 0, 0 }, false, "M0 0h1" },
+	};
+
+	for (const Case& c : cases)
+	{
+		std::string text = encode(c.digits, { c.x }, { c.y }, { c.closed });
+		bool ok = text == c.expected;
+		printf("encoder, %s: \"%s\"\n", c.what, text.c_str());
+		if (!ok)
+			printf("  expected \"%s\"\n", c.expected);
+		check(ok, c.what);
+	}
+
+	// A second subpath starts with a relative 'm', and the pairs after
+	// it are relative too, where after the first 'M' they'd be absolute
+	std::string two = encode(0, { { 0, 5, 5 }, { 20, 23, 20 } }, { { 0, 7, 0 }, { 20, 24, 28 } }, { false, false });
+	bool ok = two == "M0 0l5 7v-7m15 20 3 4-3 4";
+	printf("encoder, implicit lineto after m: \"%s\"\n", two.c_str());
+	check(ok, "implicit lineto after m");
+}
+
+// What the encoder should have written, in steps: the points on the
+// grid, with repeats left out, and the closing point left to 'z'
+static std::vector<PathPoint> expectedPoints(const std::vector<double>& xs, const std::vector<double>& ys, bool closed, double scale)
+{
+	std::vector<PathPoint> pts;
+	for (size_t i = 0; i < xs.size(); i++)
+	{
+		PathPoint p{ (int64_t)std::llround(xs[i] * scale), (int64_t)std::llround(ys[i] * scale) };
+		if (!pts.empty() && pts.back().x == p.x && pts.back().y == p.y)
+			continue;
+		pts.push_back(p);
+	}
+
+	if (closed && pts.size() > 1 && pts.back().x == pts[0].x && pts.back().y == pts[0].y)
+		pts.pop_back();
+
+	return pts;
+}
+
+// Random paths, read back, and compared point for point
+static void checkEncoderRoundTrip()
+{
+	std::mt19937_64 rng(1234);
+	std::uniform_real_distribution<double> coord(-500.0, 500.0);
+	std::uniform_real_distribution<double> step(-3.0, 3.0);
+	std::uniform_int_distribution<int> pick(0, 9);
+
+	size_t paths = 0;
+	size_t points = 0;
+	double worst = 0;
+	bool ok = true;
+
+	for (int digits = 0; digits <= 4 && ok; digits++)
+	{
+		double scale = std::pow(10.0, digits);
+		double halfStep = 0.5 / scale;
+
+		for (int trial = 0; trial < 2000 && ok; trial++)
+		{
+			std::vector<std::vector<double>> xs, ys;
+			std::vector<bool> closed;
+
+			int nsub = 1 + pick(rng) % 4;
+			for (int s = 0; s < nsub; s++)
+			{
+				std::vector<double> x, y;
+				x.push_back(coord(rng));
+				y.push_back(coord(rng));
+				int n = 1 + pick(rng) * 3;
+				for (int i = 0; i < n; i++)
+				{
+					// some repeats, some flat, some tiny, some big
+					int kind = pick(rng);
+					double dx = kind == 0 ? 0 : (kind == 1 ? 0.3 / scale : step(rng));
+					double dy = kind <= 2 ? 0 : (kind == 3 ? -0.2 / scale : step(rng));
+					if (kind == 9)
+					{
+						dx *= 100;
+						dy *= 100;
+					}
+					x.push_back(x.back() + dx);
+					y.push_back(y.back() + dy);
+				}
+
+				bool ring = pick(rng) < 5;
+				if (ring && pick(rng) < 7)
+				{
+					x.push_back(x[0]);
+					y.push_back(y[0]);
+				}
+
+				xs.push_back(x);
+				ys.push_back(y);
+				closed.push_back(ring);
+			}
+
+			std::string text = encode(digits, xs, ys, closed);
+
+			std::vector<SubPath> decoded;
+			PathReader reader(text.c_str(), digits);
+			if (!reader.read(decoded) || decoded.size() != xs.size())
+			{
+				printf("  could not read back: \"%s\"\n", text.c_str());
+				ok = false;
+				break;
+			}
+
+			for (size_t s = 0; s < xs.size() && ok; s++)
+			{
+				std::vector<PathPoint> want = expectedPoints(xs[s], ys[s], closed[s], scale);
+				const std::vector<PathPoint>& got = decoded[s].points;
+
+				if (decoded[s].closed != closed[s] || got.size() != want.size())
+				{
+					printf("  subpath %zu of \"%s\" has %zu points, expected %zu\n", s, text.c_str(), got.size(), want.size());
+					ok = false;
+					break;
+				}
+
+				for (size_t i = 0; i < got.size(); i++)
+				{
+					if (got[i].x != want[i].x || got[i].y != want[i].y)
+					{
+						printf("  point %zu of subpath %zu of \"%s\" is off\n", i, s, text.c_str());
+						ok = false;
+						break;
+					}
+				}
+
+				// and each point is within half a step of the one it came from
+				size_t k = 0;
+				for (size_t i = 0; i < xs[s].size() && k < got.size(); i++)
+				{
+					if (i > 0 && (int64_t)std::llround(xs[s][i] * scale) == got[k].x &&
+						(int64_t)std::llround(ys[s][i] * scale) == got[k].y)
+					{
+						// still on the same point
+					}
+					else if (i > 0) {
+						k++;
+						if (k >= got.size())
+							break;
+					}
+
+					double ex = std::fabs(((double)got[k].x / scale) - xs[s][i]);
+					double ey = std::fabs(((double)got[k].y / scale) - ys[s][i]);
+					double e = ex > ey ? ex : ey;
+					worst = (e / halfStep) > worst ? (e / halfStep) : worst;
+					if (e > halfStep * (1 + 1e-9))
+					{
+						printf("  point %zu of subpath %zu is %g from its source, more than half a step\n", i, s, e);
+						ok = false;
+						break;
+					}
+				}
+
+				points += got.size();
+			}
+			paths += xs.size();
+		}
+	}
+
+	printf("encoder, %zu random paths, %zu points read back, worst %.3g of a half step: %s\n",
+		paths, points, worst, ok ? "ok" : "FAILED");
+	check(ok, "encoder round trip");
+}
+
+//
+// Simplifiers
+//
+
+// A wandering line, or a ring around a wobbly circle
+static void makeShape(std::mt19937_64& rng, size_t n, bool closed, std::vector<double>& xs, std::vector<double>& ys)
+{
+	std::normal_distribution<double> noise(0.0, 1.0);
+	xs.clear();
+	ys.clear();
+
+	if (closed)
+	{
+		double r = 50;
+		for (size_t i = 0; i + 1 < n; i++)
+		{
+			double a = 2 * 3.14159265358979323846 * (double)i / (double)(n - 1);
+			double rr = r + (noise(rng) * 2);
+			xs.push_back(rr * std::cos(a));
+			ys.push_back(rr * std::sin(a));
+		}
+		xs.push_back(xs[0]);
+		ys.push_back(ys[0]);
+	}
+	else {
+		double x = 0, y = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			x += 1 + std::fabs(noise(rng));
+			y += noise(rng);
+			xs.push_back(x);
+			ys.push_back(y);
+		}
+	}
+}
+
+// Every vertex Douglas-Peucker dropped is within the tolerance of the
+// segment between the kept vertices either side of it
+static bool dpWithinTolerance(const std::vector<double>& xs, const std::vector<double>& ys, const uint8_t* keep, double tol)
+{
+	double tol2 = tol * tol * (1 + 1e-12);
+	size_t prev = 0;
+	for (size_t i = 1; i < xs.size(); i++)
+	{
+		if (keep[i])
+		{
+			for (size_t k = prev + 1; k < i; k++)
+			{
+				if (simplifySegmentDistance2(xs[k], ys[k], xs[prev], ys[prev], xs[i], ys[i]) > tol2)
+					return false;
+			}
+			prev = i;
+		}
+	}
+	return true;
+}
+
+static void checkSimplifiers()
+{
+	std::mt19937_64 rng(5678);
+	std::vector<double> xs, ys;
+	std::vector<uint8_t> keep;
+	std::vector<size_t> stack;
+	SimplifyVWScratch scratch;
+
+	const size_t sizes[] = { 2, 3, 4, 5, 6, 10, 100, 5000 };
+	const double tolerances[] = { 0.0, 0.5, 2.0, 10.0, 1e9 };
+
+	bool dpOk = true;
+	bool vwOk = true;
+	size_t runs = 0;
+
+	for (int c = 0; c < 2; c++)
+	{
+		bool closed = c == 1;
+		for (size_t n : sizes)
+		{
+			if (closed && n < 4)
+				continue;
+
+			for (double tol : tolerances)
+			{
+				makeShape(rng, n, closed, xs, ys);
+				keep.assign(n, 0);
+				runs++;
+
+				size_t minPoints = simplifyMinPoints(closed);
+				size_t want = n < minPoints ? n : minPoints;
+
+				// Douglas-Peucker
+				size_t kept = simplifyDouglasPeucker(xs.data(), ys.data(), n, tol, closed, keep.data(), stack);
+				size_t counted = 0;
+				for (size_t i = 0; i < n; i++)
+					counted += keep[i];
+
+				bool ok = kept == counted && kept >= want && keep[0] && keep[n - 1] &&
+					dpWithinTolerance(xs, ys, keep.data(), tol);
+				if (tol == 0)
+					ok = ok && kept == n;
+				if (!ok)
+				{
+					printf("  Douglas-Peucker, %s of %zu, tolerance %g, kept %zu\n", closed ? "ring" : "line", n, tol, kept);
+					dpOk = false;
+				}
+
+				// Visvalingam-Whyatt
+				kept = simplifyVisvalingam(xs.data(), ys.data(), n, tol, closed, keep.data(), scratch);
+				counted = 0;
+				for (size_t i = 0; i < n; i++)
+					counted += keep[i];
+
+				ok = kept == counted && kept >= want && keep[0] && keep[n - 1];
+				if (tol == 0)
+					ok = ok && kept == n;
+				if (tol >= 1e9)
+					ok = ok && kept == want;
+				if (!ok)
+				{
+					printf("  Visvalingam, %s of %zu, tolerance %g, kept %zu\n", closed ? "ring" : "line", n, tol, kept);
+					vwOk = false;
+				}
+			}
+		}
+	}
+
+	// A ring that's all in a line still comes out as a ring
+	xs = { 0, 1, 2, 3, 4, 5, 0 };
+	ys = { 0, 0, 0, 0, 0, 0, 0 };
+	keep.assign(xs.size(), 0);
+	size_t flat = simplifyDouglasPeucker(xs.data(), ys.data(), xs.size(), 1.0, true, keep.data(), stack);
+	if (flat < 4)
+	{
+		printf("  Douglas-Peucker, flat ring kept %zu\n", flat);
+		dpOk = false;
+	}
+	flat = simplifyVisvalingam(xs.data(), ys.data(), xs.size(), 1.0, true, keep.data(), scratch);
+	if (flat < 4)
+	{
+		printf("  Visvalingam, flat ring kept %zu\n", flat);
+		vwOk = false;
+	}
+
+	printf("Douglas-Peucker, %zu shapes, within tolerance, ends kept, enough left: %s\n", runs, dpOk ? "ok" : "FAILED");
+	printf("Visvalingam, %zu shapes, ends kept, enough left: %s\n", runs, vwOk ? "ok" : "FAILED");
+	check(dpOk, "Douglas-Peucker");
+	check(vwOk, "Visvalingam");
+
+	// Through PathSimplifier, a ring still starts and ends on the same point
+	bool streamOk = true;
+	for (int m = 0; m < 2; m++)
+	{
+		PathSimplifier simp(m == 0 ? SimplifyMethod::DouglasPeucker : SimplifyMethod::Visvalingam, 5.0);
+		for (int r = 0; r < 50; r++)
+		{
+			makeShape(rng, 20 + (r * 37), true, xs, ys);
+			simp.reset();
+			simp.add(xs.data(), ys.data(), xs.size());
+			size_t kept = simp.simplify(true);
+			if (kept < 4 || kept != simp.size() || simp.x()[0] != simp.x()[kept - 1] || simp.y()[0] != simp.y()[kept - 1])
+				streamOk = false;
+		}
+	}
+	printf("PathSimplifier, rings stay closed: %s\n", streamOk ? "ok" : "FAILED");
+	check(streamOk, "PathSimplifier rings");
+}
+
+// Snapped points are on the grid, with no two the same in a row
+static void checkSnap()
+{
+	std::mt19937_64 rng(91011);
+	std::vector<double> xs, ys;
+	const double cells[] = { 0.25, 1.0, 7.5 };
+
+	bool ok = true;
+	size_t dropped = 0;
+	for (double cell : cells)
+	{
+		for (int r = 0; r < 200; r++)
+		{
+			makeShape(rng, 10 + r * 13, (r & 1) != 0, xs, ys);
+			std::vector<double> sx = xs, sy = ys;
+			size_t n = simplifySnapToGrid(sx.data(), sy.data(), sx.size(), cell, 0.5, -0.25);
+			dropped += xs.size() - n;
+
+			for (size_t i = 0; i < n; i++)
+			{
+				double gx = (sx[i] - 0.5) / cell;
+				double gy = (sy[i] + 0.25) / cell;
+				if (std::fabs(gx - std::round(gx)) > 1e-9 || std::fabs(gy - std::round(gy)) > 1e-9)
+					ok = false;
+				if (i > 0 && sx[i] == sx[i - 1] && sy[i] == sy[i - 1])
+					ok = false;
+			}
+
+			// and nothing moves further than half a cell, each way
+			size_t k = 0;
+			for (size_t i = 0; i < xs.size() && ok; i++)
+			{
+				while (k < n && (std::fabs(sx[k] - xs[i]) > cell * 0.5 * (1 + 1e-9) ||
+					std::fabs(sy[k] - ys[i]) > cell * 0.5 * (1 + 1e-9)))
+					k++;
+				if (k >= n)
+					ok = false;
+			}
+		}
+	}
+
+	printf("snap to grid, on the grid, no repeats, %zu dropped: %s\n", dropped, ok ? "ok" : "FAILED");
+	check(ok, "snap to grid");
+}
+
+int main()
+{
+	checkEncoderText();
+	checkEncoderRoundTrip();
+	checkSimplifiers();
+	checkSnap();
+
+	if (gFailures > 0)
+	{
+		printf("%d FAILED\n", gFailures);
+		return 1;
+	}
+
+	printf("all passed\n");
+	return 0;
+}